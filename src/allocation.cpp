@@ -0,0 +1,102 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#include "allocation.h"
+#include <atomic>
+
+
+allocation_stats::allocation_stats()
+: allocations(0),
+  bullet_allocations(0),
+  bytes(0),
+  bullet_bytes(0),
+  frees(0),
+  bullet_frees(0)
+{}
+unsigned long long allocation_stats::total_allocations() const
+{
+  return allocations + bullet_allocations;
+}
+
+
+// Zero-initialized before any dynamic initialization, so allocations made
+// by other static constructors are safe to count
+static std::atomic<bool> installed_;
+static std::atomic<unsigned long long> allocations, bullet_allocations;
+static std::atomic<unsigned long long> bytes, bullet_bytes;
+static std::atomic<unsigned long long> frees, bullet_frees;
+
+bool allocation_counter::installed()
+{
+  return installed_.load(std::memory_order_relaxed);
+}
+void allocation_counter::installed(bool i)
+{
+  installed_.store(i, std::memory_order_relaxed);
+}
+allocation_stats allocation_counter::totals()
+{
+  allocation_stats s;
+  s.allocations = allocations.load(std::memory_order_relaxed);
+  s.bullet_allocations = bullet_allocations.load(std::memory_order_relaxed);
+  s.bytes = bytes.load(std::memory_order_relaxed);
+  s.bullet_bytes = bullet_bytes.load(std::memory_order_relaxed);
+  s.frees = frees.load(std::memory_order_relaxed);
+  s.bullet_frees = bullet_frees.load(std::memory_order_relaxed);
+  return s;
+}
+
+void allocation_counter::count(std::size_t size)
+{
+  if( !installed() ) return;
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  bytes.fetch_add(size, std::memory_order_relaxed);
+}
+void allocation_counter::count_free()
+{
+  if( !installed() ) return;
+  frees.fetch_add(1, std::memory_order_relaxed);
+}
+void allocation_counter::count_bullet(std::size_t size)
+{
+  bullet_allocations.fetch_add(1, std::memory_order_relaxed);
+  bullet_bytes.fetch_add(size, std::memory_order_relaxed);
+}
+void allocation_counter::count_bullet_free()
+{
+  bullet_frees.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+#include <LinearMath/btAlignedAllocator.h>
+#include <cstdlib>
+static void * bullet_alloc(std::size_t size)
+{
+  allocation_counter::count_bullet(size);
+  return std::malloc(size);
+}
+static void bullet_free(void * memory)
+{
+  if(memory) allocation_counter::count_bullet_free();
+  std::free(memory);
+}
+
+void allocation_counter::install()
+{
+  btAlignedAllocSetCustom(bullet_alloc, bullet_free);
+  installed(true);
+}
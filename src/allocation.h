@@ -0,0 +1,65 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#ifndef ALLOCATION_H_INCLUDED
+#define ALLOCATION_H_INCLUDED
+
+
+#include <cstddef>
+
+
+// Heap use since allocation_counter::install()
+class allocation_stats
+{
+public:
+  allocation_stats();
+
+  // Through operator new, and through Bullet's btAlignedAlloc
+  unsigned long long allocations, bullet_allocations;
+  unsigned long long bytes, bullet_bytes;
+  unsigned long long frees, bullet_frees;
+
+  // Both kinds together
+  unsigned long long total_allocations() const;
+};
+
+/*
+ * Counts heap allocations, to find and guard against allocation on hot
+ * paths. Installing hooks Bullet's allocator. Allocations through operator
+ * new are only counted in programs that also link the replacement operators
+ * in bench/allocation_new.cpp, as tdse_bench does; the library itself keeps
+ * the standard ones. Counting is a relaxed atomic add.
+ * bullet_world::stats() reports the allocations made during steps.
+ */
+class allocation_counter
+{
+public:
+  // Call early, before Bullet allocates anything that outlives it
+  static void install();
+  static bool installed();
+  static allocation_stats totals();
+
+  // Used by the hooks
+  static void installed(bool i);
+  static void count(std::size_t bytes);
+  static void count_free();
+  static void count_bullet(std::size_t bytes);
+  static void count_bullet_free();
+};
+
+
+#endif  // ALLOCATION_H_INCLUDED
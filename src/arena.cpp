@@ -0,0 +1,126 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#include "arena.h"
+#include <iterator>
+
+
+const projectile::properties arena::bullet_type(0.008f, 1000.0f);
+
+arena::fighter::fighter(std::uint32_t serial_, const glm::vec2 & position,
+                        random_engine & prand)
+: serial(serial_),
+  avatar(position, bullet_type, prand)
+{}
+
+
+arena::arena(std::uint32_t seed_, const world_options & options_)
+: seed(seed_),
+  options(options_),
+  physics(options),
+  prand(seed),
+  next_serial(0),
+  recorder(nullptr)
+{}
+arena::~arena()
+{
+  while( !fighters_.empty() ) despawn( fighters_.front() );
+}
+
+arena::fighter & arena::spawn()
+{
+  uniform_variate spawn_dist(-20.0f, 20.0f);
+  // Separate statements, since argument order is unspecified
+  float x = spawn_dist(prand);
+  float y = spawn_dist(prand);
+  fighters_.emplace_back( next_serial, glm::vec2(x, y), prand );
+  fighter & f = fighters_.back();
+  serials[next_serial++] = std::prev( fighters_.end() );
+
+  physics.add_body(f.avatar);
+  physics.add_callback( static_cast<biped &>(f.avatar) );
+  physics.add_callback( static_cast<shooter &>(f.avatar),
+                        bullet_world::weapons_phase );
+  if(recorder) recorder->spawn(f.serial);
+  return f;
+}
+void arena::despawn(fighter & f)
+{
+  if(recorder) recorder->despawn(f.serial);
+  physics.remove_callback( static_cast<shooter &>(f.avatar) );
+  physics.remove_callback( static_cast<biped &>(f.avatar) );
+  physics.remove_body(f.avatar);
+  auto found = serials.find(f.serial);
+  fighters_.erase(found->second);
+  serials.erase(found);
+}
+arena::fighter & arena::find(std::uint32_t serial)
+{
+  return *serials.at(serial);
+}
+
+static bool same(const player & a, const player & b)
+{
+  return a.movement == b.movement && a.aim == b.aim && a.fire == b.fire;
+}
+void arena::tick()
+{
+  for(auto i = fighters_.begin(); i != fighters_.end(); ++i)
+  {
+    if( recorder && !same(i->controls, i->recorded) )
+    {
+      recorder->input(i->serial, i->controls);
+      i->recorded = i->controls;
+    }
+    i->controls.apply_input(i->avatar);
+    i->avatar.weapon.step( physics.substep() );
+  }
+  physics.step_ticks(1);
+  if(recorder) recorder->end_tick();
+}
+
+void arena::record(replay_writer * writer)
+{
+  recorder = writer;
+  // Fighters that already exist start with default controls in the replay
+  for(auto i = fighters_.begin(); i != fighters_.end(); ++i)
+    i->recorded = player();
+}
+replay_header arena::header() const
+{
+  replay_header h;
+  h.seed = seed;
+  h.options = options;
+  return h;
+}
+
+bullet_world & arena::world()
+{
+  return physics;
+}
+const bullet_world & arena::world() const
+{
+  return physics;
+}
+const std::list<arena::fighter> & arena::fighters() const
+{
+  return fighters_;
+}
+std::size_t arena::projectiles() const
+{
+  return physics.projectiles().size();
+}
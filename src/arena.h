@@ -0,0 +1,95 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#ifndef ARENA_H_INCLUDED
+#define ARENA_H_INCLUDED
+
+
+#include "biped.h"
+#include "input.h"
+#include "random.h"
+#include "replay.h"
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+
+
+/*
+ * The game tdse_server runs: soldiers spawned into a world as players join,
+ * each driven by its player's controls. Everything random comes from the
+ * seed through random.h, so the same seed, spawns and input reproduce the
+ * same game on any platform, which is what replays rely on.
+ */
+class arena
+{
+public:
+  static const projectile::properties bullet_type;
+
+  class fighter
+  {
+  public:
+    fighter(std::uint32_t serial_, const glm::vec2 & position,
+            random_engine & prand);
+
+    // Spawn order, counting from zero
+    const std::uint32_t serial;
+    soldier avatar;
+    // Applied every tick
+    player controls;
+
+  private:
+    friend class arena;
+    // As last written to the replay
+    player recorded;
+  };
+
+  arena( std::uint32_t seed_, const world_options & options =
+           world_options() );
+  ~arena();
+  arena(const arena &) = delete;
+  void operator = (const arena &) = delete;
+
+  fighter & spawn();
+  void despawn(fighter & f);
+  // Throws std::out_of_range if there is no such fighter
+  fighter & find(std::uint32_t serial);
+  // Apply every fighter's controls and step once
+  void tick();
+
+  // Write everything that happens to writer, until called with nullptr
+  void record(replay_writer * writer);
+  replay_header header() const;
+
+  bullet_world & world();
+  const bullet_world & world() const;
+  const std::list<fighter> & fighters() const;
+  // Projectiles in flight
+  std::size_t projectiles() const;
+
+private:
+  const std::uint32_t seed;
+  const world_options options;
+  bullet_world physics;
+  random_engine prand;
+  std::list<fighter> fighters_;
+  std::unordered_map< std::uint32_t, std::list<fighter>::iterator > serials;
+  std::uint32_t next_serial;
+  replay_writer * recorder;
+};
+
+
+#endif  // ARENA_H_INCLUDED
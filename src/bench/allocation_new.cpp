@@ -0,0 +1,95 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+// Replacements for the global operator new and delete, counting through
+// allocation_counter. Only tdse_bench links this; the library leaves the
+// standard operators alone everywhere else.
+
+
+#include "allocation.h"
+#include <cstdlib>
+#include <new>
+
+
+static void * counted_new(std::size_t size)
+{
+  allocation_counter::count(size);
+  // malloc(0) may return null
+  if(size == 0) size = 1;
+  while(true)
+  {
+    if( void * memory = std::malloc(size) ) return memory;
+    std::new_handler handler = std::get_new_handler();
+    if(!handler) return nullptr;
+    handler();
+  }
+}
+static void counted_delete(void * memory)
+{
+  if(!memory) return;
+  allocation_counter::count_free();
+  std::free(memory);
+}
+
+void * operator new(std::size_t size)
+{
+  if( void * memory = counted_new(size) ) return memory;
+  throw std::bad_alloc();
+}
+void * operator new[](std::size_t size)
+{
+  if( void * memory = counted_new(size) ) return memory;
+  throw std::bad_alloc();
+}
+void * operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+  try
+  {
+    return counted_new(size);
+  }
+  catch(const std::bad_alloc &)
+  {
+    return nullptr;
+  }
+}
+void * operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+  try
+  {
+    return counted_new(size);
+  }
+  catch(const std::bad_alloc &)
+  {
+    return nullptr;
+  }
+}
+void operator delete(void * memory) noexcept
+{
+  counted_delete(memory);
+}
+void operator delete[](void * memory) noexcept
+{
+  counted_delete(memory);
+}
+void operator delete(void * memory, const std::nothrow_t &) noexcept
+{
+  counted_delete(memory);
+}
+void operator delete[](void * memory, const std::nothrow_t &) noexcept
+{
+  counted_delete(memory);
+}
@@ -0,0 +1,163 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+// Compares grid_broadphase against Bullet's DBVT and axis sweep broadphases
+// on a planar crowd of biped sized boxes, a tenth of which move every step.
+
+
+#include "grid_broadphase.h"
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+typedef std::chrono::duration<double, std::micro> double_microseconds;
+
+class counting_ray : public btBroadphaseRayCallback
+{
+public:
+  counting_ray(const btVector3 & from, const btVector3 & to)
+  : candidates(0)
+  {
+    btVector3 direction = (to - from).normalized();
+    for(int i = 0; i < 3; ++i)
+      m_rayDirectionInverse[i] = direction[i] == 0.0f ?
+        BT_LARGE_FLOAT : 1.0f/direction[i];
+    for(int i = 0; i < 3; ++i)
+      m_signs[i] = m_rayDirectionInverse[i] < 0.0f;
+    m_lambda_max = direction.dot(to - from);
+  }
+  bool process(const btBroadphaseProxy * proxy) override
+  {
+    ++candidates;
+    return true;
+  }
+
+  unsigned long candidates;
+};
+
+class result
+{
+public:
+  double_microseconds update, rays;
+  int pairs;
+  unsigned long candidates;
+};
+
+static const float half_size = 0.3f;
+result run(btBroadphaseInterface & broadphase, btDispatcher & dispatcher,
+           int proxies, float extent)
+{
+  static const int steps = 20;
+  static const int num_rays = 1000;
+  std::default_random_engine prand(1);
+  std::uniform_real_distribution<float> place(-extent, extent);
+  std::uniform_real_distribution<float> nudge(-0.1f, 0.1f);
+  const btVector3 half(half_size, half_size, 1.0f);
+
+  std::vector<btVector3> centers;
+  std::vector<btBroadphaseProxy *> handles;
+  centers.reserve(proxies);
+  handles.reserve(proxies);
+  for(int i = 0; i < proxies; ++i)
+  {
+    centers.emplace_back(place(prand), place(prand), 0.0f);
+    handles.push_back( broadphase.createProxy(
+      centers.back() - half, centers.back() + half, BOX_SHAPE_PROXYTYPE,
+      nullptr, btBroadphaseProxy::DefaultFilter,
+      btBroadphaseProxy::AllFilter, &dispatcher
+    ) );
+  }
+  broadphase.calculateOverlappingPairs(&dispatcher);
+
+  result r;
+  auto start = std::chrono::steady_clock::now();
+  for(int step = 0; step < steps; ++step)
+  {
+    for(int i = step % 10; i < proxies; i += 10)
+    {
+      centers[i] += btVector3(nudge(prand), nudge(prand), 0.0f);
+      broadphase.setAabb(handles[i], centers[i] - half, centers[i] + half,
+                         &dispatcher);
+    }
+    broadphase.calculateOverlappingPairs(&dispatcher);
+  }
+  r.update = (std::chrono::steady_clock::now() - start)/double(steps);
+  r.pairs = broadphase.getOverlappingPairCache()->getNumOverlappingPairs();
+
+  // Projectile length rays, as fired in one substep
+  r.candidates = 0;
+  start = std::chrono::steady_clock::now();
+  for(int i = 0; i < num_rays; ++i)
+  {
+    btVector3 from(place(prand), place(prand), 0.0f);
+    btVector3 to = from + btVector3(6.0f, 2.0f, 0.0f);
+    counting_ray ray(from, to);
+    broadphase.rayTest(from, to, ray);
+    r.candidates += ray.candidates;
+  }
+  r.rays = (std::chrono::steady_clock::now() - start)/double(num_rays);
+
+  for(auto i = handles.begin(); i != handles.end(); ++i)
+    broadphase.destroyProxy(*i, &dispatcher);
+  return r;
+}
+
+void report(const char * name, int proxies, const result & r)
+{
+  std::cout << std::setw(10) << name << std::setw(8) << proxies
+            << std::setw(14) << r.update.count()
+            << std::setw(12) << r.rays.count()
+            << std::setw(10) << r.pairs
+            << std::setw(12) << r.candidates << '\n';
+}
+
+int main()
+{
+  btDefaultCollisionConfiguration config;
+  btCollisionDispatcher dispatcher(&config);
+
+  std::cout << std::setw(10) << "broadphase" << std::setw(8) << "proxies"
+            << std::setw(14) << "us/update" << std::setw(12) << "us/ray"
+            << std::setw(10) << "pairs" << std::setw(12) << "candidates"
+            << '\n';
+  const int counts[] = {1000, 10000, 100000};
+  for(int proxies : counts)
+  {
+    // Keep density constant at about one body per 4 square meters
+    float extent = std::sqrt( float(proxies) );
+    btVector3 world_min(-extent - 10.0f, -extent - 10.0f, -10.0f);
+    btVector3 world_max(extent + 10.0f, extent + 10.0f, 10.0f);
+
+    {
+      btDbvtBroadphase dbvt;
+      report( "dbvt", proxies, run(dbvt, dispatcher, proxies, extent) );
+    }
+    {
+      std::unique_ptr<bt32BitAxisSweep3> sweep(
+        new bt32BitAxisSweep3(world_min, world_max, proxies + 1)
+      );
+      report( "sweep", proxies, run(*sweep, dispatcher, proxies, extent) );
+    }
+    {
+      grid_broadphase grid(1.0f);
+      report( "grid", proxies, run(grid, dispatcher, proxies, extent) );
+    }
+  }
+}
@@ -0,0 +1,112 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+// Compares collision dispatch through dynamic_cast against the handler
+// pointers that bullet_world::add_body resolves once per body.
+
+
+#include "projectile.h"
+class bumper : public actor, public needs_collision
+{
+public:
+  bumper(const glm::vec2 & position)
+  : actor( 1.0f, shape, compose_transform(position) ),
+    bumps(0)
+  {}
+  void collision(body & b) override
+  {
+    ++bumps;
+  }
+
+  static const btSphereShape shape;
+  unsigned long bumps;
+};
+const btSphereShape bumper::shape(0.25f);
+
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+typedef std::chrono::duration<double, std::nano> double_nanoseconds;
+
+template<class Dispatch> double_nanoseconds time_pairs
+(const std::vector< std::pair<body *, body *> > & pairs, int rounds,
+ Dispatch dispatch)
+{
+  auto start = std::chrono::steady_clock::now();
+  for(int round = 0; round < rounds; ++round)
+    for(auto i = pairs.begin(); i != pairs.end(); ++i)
+      dispatch(*i->first, *i->second);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed/double(pairs.size()*rounds);
+}
+
+int main()
+{
+  static const int num_bodies = 4096;
+  static const int num_pairs = 65536;
+  static const int rounds = 64;
+
+  bullet_world physics;
+  // Half the bodies react to collisions and half are plain actors, which
+  // exercises both outcomes of the capability check
+  std::vector<bumper> bumpers;
+  std::vector<actor> actors;
+  bumpers.reserve(num_bodies/2);
+  actors.reserve(num_bodies/2);
+  std::vector<body *> bodies;
+  for(int i = 0; i < num_bodies/2; ++i)
+  {
+    glm::vec2 position(i*1.0f, 0.0f);
+    bumpers.emplace_back(position);
+    actors.emplace_back( 1.0f, bumper::shape, compose_transform(position) );
+    physics.add_body( bumpers.back() );
+    physics.add_body( actors.back() );
+    bodies.push_back( &bumpers.back() );
+    bodies.push_back( &actors.back() );
+  }
+
+  std::default_random_engine prand(1);
+  std::uniform_int_distribution<int> pick(0, num_bodies - 1);
+  std::vector< std::pair<body *, body *> > pairs;
+  pairs.reserve(num_pairs);
+  for(int i = 0; i < num_pairs; ++i)
+    pairs.emplace_back( bodies[pick(prand)], bodies[pick(prand)] );
+
+  auto rtti = time_pairs(pairs, rounds, [](body & b0, body & b1)
+  {
+    needs_collision * ptr;
+    if( (ptr = dynamic_cast<needs_collision *>(&b0)) ) ptr->collision(b1);
+    if( (ptr = dynamic_cast<needs_collision *>(&b1)) ) ptr->collision(b0);
+  });
+  auto tagged = time_pairs(pairs, rounds, [](body & b0, body & b1)
+  {
+    if(needs_collision * ptr = b0.collision_handler()) ptr->collision(b1);
+    if(needs_collision * ptr = b1.collision_handler()) ptr->collision(b0);
+  });
+
+  unsigned long bumps = 0;
+  for(auto i = bumpers.begin(); i != bumpers.end(); ++i)
+    bumps += i->bumps;
+  std::cout << "dynamic_cast: " << rtti.count() << " ns/pair\n"
+            << "handler:      " << tagged.count() << " ns/pair\n"
+            << "(" << bumps << " collisions dispatched)" << std::endl;
+
+  for(auto i = bodies.begin(); i != bodies.end(); ++i)
+    physics.remove_body(**i);
+}
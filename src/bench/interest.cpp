@@ -0,0 +1,114 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+// Compares finding each client's relevant entities by scanning every entity
+// against an interest_grid kept up to date as entities move, on a large map
+// where each client sees a small part of it.
+
+
+#include "interest.h"
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+typedef std::chrono::duration<double, std::micro> double_microseconds;
+
+class result
+{
+public:
+  double_microseconds brute, grid;
+  double relevant;
+};
+
+result run(int entities, int clients, float extent, float radius)
+{
+  static const int ticks = 20;
+  std::default_random_engine prand(1);
+  std::uniform_real_distribution<float> place(-extent, extent);
+  std::uniform_real_distribution<float> nudge(-0.1f, 0.1f);
+
+  std::vector<glm::vec2> positions;
+  positions.reserve(entities);
+  interest_grid grid(radius);
+  for(int i = 0; i < entities; ++i)
+  {
+    positions.emplace_back( place(prand), place(prand) );
+    grid.insert( i, positions.back() );
+  }
+  // Clients watch the first entities, as if they were their avatars
+  std::vector<interest_set> sets(clients);
+  std::vector<std::uint32_t> brute_relevant;
+
+  result r;
+  r.brute = r.grid = double_microseconds(0);
+  unsigned long long relevant = 0;
+  for(int tick = 0; tick < ticks; ++tick)
+  {
+    for(auto i = positions.begin(); i != positions.end(); ++i)
+      *i += glm::vec2( nudge(prand), nudge(prand) );
+
+    auto start = std::chrono::steady_clock::now();
+    const float radius2 = radius*radius;
+    for(int c = 0; c < clients; ++c)
+    {
+      brute_relevant.clear();
+      for(int i = 0; i < entities; ++i)
+      {
+        glm::vec2 offset = positions[i] - positions[c];
+        if(glm::dot(offset, offset) <= radius2) brute_relevant.push_back(i);
+      }
+    }
+    r.brute += std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    for(int i = 0; i < entities; ++i)
+      grid.move(i, positions[i]);
+    for(int c = 0; c < clients; ++c)
+    {
+      sets[c].update(grid, positions[c], radius);
+      relevant += sets[c].relevant().size();
+    }
+    r.grid += std::chrono::steady_clock::now() - start;
+  }
+  r.brute /= ticks;
+  r.grid /= ticks;
+  r.relevant = double(relevant)/(ticks*clients);
+  return r;
+}
+
+int main()
+{
+  static const float radius = 40.0f;
+  std::cout << std::setw(10) << "entities" << std::setw(10) << "clients"
+            << std::setw(14) << "brute us/tick" << std::setw(14)
+            << "grid us/tick" << std::setw(12) << "relevant" << '\n';
+  const int entity_counts[] = {1000, 10000, 50000};
+  const int client_counts[] = {64, 512};
+  for(int entities : entity_counts)
+    for(int clients : client_counts)
+    {
+      // Keep density at about one entity per 100 square meters
+      float extent = 5.0f*std::sqrt( float(entities) );
+      result r = run(entities, clients, extent, radius);
+      std::cout << std::setw(10) << entities << std::setw(10) << clients
+                << std::setw(14) << r.brute.count()
+                << std::setw(14) << r.grid.count()
+                << std::setw(12) << r.relevant << '\n';
+    }
+}
@@ -0,0 +1,127 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+// Compares the projectile_kernel paths supported here against the scalar one,
+// and checks that they give identical results.
+
+
+#include "projectile_kernel.h"
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+typedef std::chrono::duration<double, std::nano> double_nanoseconds;
+
+class shots
+{
+public:
+  shots(std::size_t count, std::default_random_engine & prand)
+  : positions(count), velocities(count), origins(count),
+    range_squared(count), times(count), targets(count), expired(count)
+  {
+    std::uniform_real_distribution<float> place(-100.0f, 100.0f);
+    std::uniform_real_distribution<float> speed(-400.0f, 400.0f);
+    std::uniform_real_distribution<float> range(0.0f, 200.0f);
+    std::uniform_real_distribution<float> time(0.0f, 1.0f/60.0f);
+    for(std::size_t i = 0; i != count; ++i)
+    {
+      // Separate statements, since argument order is unspecified
+      positions[i].x = place(prand);
+      positions[i].y = place(prand);
+      velocities[i].x = speed(prand);
+      velocities[i].y = speed(prand);
+      origins[i].x = place(prand);
+      origins[i].y = place(prand);
+      float r = range(prand);
+      range_squared[i] = r*r;
+      times[i] = time(prand);
+    }
+  }
+
+  void step(projectile_kernel::path kernel)
+  {
+    projectile_kernel::step( kernel, positions.size(), positions.data(),
+                             velocities.data(), origins.data(),
+                             range_squared.data(), times.data(),
+                             targets.data(), expired.data() );
+  }
+  bool same_results(const shots & other) const
+  {
+    return std::memcmp( targets.data(), other.targets.data(),
+                        targets.size()*sizeof(glm::vec2) ) == 0 &&
+           expired == other.expired;
+  }
+
+  std::vector<glm::vec2> positions, velocities, origins;
+  std::vector<float> range_squared, times;
+  std::vector<glm::vec2> targets;
+  std::vector<unsigned char> expired;
+};
+
+// Nanoseconds per shot, over enough runs to take about 0.1 s
+static double run(shots & s, projectile_kernel::path kernel)
+{
+  const std::size_t runs = 1 + 20000000/s.positions.size();
+  s.step(kernel);
+  auto start = std::chrono::steady_clock::now();
+  for(std::size_t i = 0; i != runs; ++i)
+    s.step(kernel);
+  double_nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count()/(runs*s.positions.size());
+}
+
+int main()
+{
+  const projectile_kernel::path paths[] = {
+    projectile_kernel::scalar, projectile_kernel::sse2, projectile_kernel::avx
+  };
+  std::cout << "best path: "
+            << projectile_kernel::name( projectile_kernel::best() ) << "\n\n"
+            << std::setw(8) << "path" << std::setw(10) << "shots"
+            << std::setw(12) << "ns/shot" << std::setw(10) << "speedup"
+            << '\n';
+
+  bool identical = true;
+  // Odd counts leave tails for the scalar loop
+  const std::size_t counts[] = {64, 1027, 16384, 262147};
+  for(std::size_t count : counts)
+  {
+    std::default_random_engine prand(1);
+    shots reference(count, prand);
+    double scalar_time = run(reference, projectile_kernel::scalar);
+    for(projectile_kernel::path kernel : paths)
+    {
+      if( !projectile_kernel::supported(kernel) ) continue;
+      shots s = reference;
+      double time = kernel == projectile_kernel::scalar ?
+        scalar_time : run(s, kernel);
+      std::cout << std::setw(8) << projectile_kernel::name(kernel)
+                << std::setw(10) << count << std::fixed
+                << std::setw(12) << std::setprecision(3) << time
+                << std::setw(10) << std::setprecision(2) << scalar_time/time
+                << '\n';
+      if( !s.same_results(reference) )
+      {
+        std::cout << "  results differ from scalar\n";
+        identical = false;
+      }
+    }
+  }
+  return identical ? 0 : 1;
+}
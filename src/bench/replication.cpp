@@ -0,0 +1,221 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+// Bytes per entity for replication frames on the demo scenarios, against
+// sending each body's model matrix, and the worst round-trip error seen.
+// Frames are acknowledged at once, and again with a round trip of latency.
+
+
+#include "input.h"
+#include "random.h"
+#include "replication.h"
+#include "static_geometry.h"
+#include <glm/gtc/constants.hpp>
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Wander like a player would, changing course about twice a second
+void wander(player & input, random_engine & prand)
+{
+  std::uniform_int_distribution<int> chance(0, 29);
+  if(chance(prand) != 0) return;
+  std::uniform_real_distribution<float> angle(0.0f, 2*glm::pi<float>());
+  float a = angle(prand);
+  input.movement = glm::vec2( glm::cos(a), glm::sin(a) );
+  a = angle(prand);
+  input.aim = glm::vec2( glm::cos(a), glm::sin(a) );
+  input.fire = chance(prand) < 15;
+}
+
+float angle_difference(float a, float b)
+{
+  float d = std::fabs(a - b);
+  return std::min( d, 2*glm::pi<float>() - d );
+}
+
+void measure(const char * name, bullet_world & physics,
+             const std::vector<const body *> & bodies,
+             std::function<void ()> drive)
+{
+  static const int ticks = 600;
+  // About 100 ms at the default substep
+  static const std::size_t latency = 6;
+  // Large enough that every frame is complete
+  static const std::size_t max_frame = 1 << 16;
+
+  replication_encoder instant, lagged;
+  replication_decoder instant_decoder, lagged_decoder;
+  std::deque<std::uint16_t> in_flight;
+  std::vector<body_state> states, decoded;
+  std::vector<unsigned char> frame;
+  std::size_t first_frame = 0;
+  unsigned long long instant_bytes = 0, lagged_bytes = 0;
+  float position_error = 0.0f, angle_error = 0.0f, velocity_error = 0.0f,
+        spin_error = 0.0f;
+
+  for(int tick = 0; tick < ticks; ++tick)
+  {
+    drive();
+    physics.step_ticks(1);
+    states.clear();
+    for(auto i = bodies.begin(); i != bodies.end(); ++i)
+      states.emplace_back(**i);
+    std::sort( states.begin(), states.end(),
+      [](const body_state & a, const body_state & b)
+      {
+        return a.id < b.id;
+      }
+    );
+
+    frame.clear();
+    std::uint16_t sequence = instant.encode(states, frame, max_frame);
+    if(tick == 0) first_frame = frame.size();
+    else instant_bytes += frame.size();
+    instant_decoder.decode(frame.data(), frame.size(), decoded);
+    instant.acknowledge(sequence);
+    for(std::size_t i = 0; i < states.size(); ++i)
+    {
+      const body_state & s = states[i], & d = decoded[i];
+      position_error = std::max( {position_error,
+        std::fabs(s.position.x - d.position.x),
+        std::fabs(s.position.y - d.position.y)} );
+      angle_error = std::max( angle_error,
+                              angle_difference(s.angle, d.angle) );
+      velocity_error = std::max( {velocity_error,
+        std::fabs(s.velocity.x - d.velocity.x),
+        std::fabs(s.velocity.y - d.velocity.y)} );
+      spin_error = std::max( spin_error,
+        std::fabs(s.angular_velocity - d.angular_velocity) );
+    }
+
+    frame.clear();
+    in_flight.push_back( lagged.encode(states, frame, max_frame) );
+    if(tick != 0) lagged_bytes += frame.size();
+    lagged_decoder.decode(frame.data(), frame.size(), decoded);
+    if(in_flight.size() > latency)
+    {
+      lagged.acknowledge( in_flight.front() );
+      in_flight.pop_front();
+    }
+  }
+
+  const double entity_ticks = double( bodies.size() )*(ticks - 1);
+  const replication_format & format = instant.format;
+  std::cout << std::setw(14) << name << std::setw(10) << bodies.size()
+            << std::setw(8) << sizeof(glm::mat3)
+            << std::setw(8) << double(first_frame)/bodies.size()
+            << std::setw(10) << instant_bytes/entity_ticks
+            << std::setw(10) << lagged_bytes/entity_ticks << '\n'
+            << "  worst error (bound): position " << position_error
+            << " (" << format.position_error() << ") m, angle "
+            << angle_error << " (" << format.angle_error() << ") rad, "
+            << "velocity " << velocity_error << " ("
+            << format.velocity_error() << ") m/s, spin " << spin_error
+            << " (" << format.angular_velocity_error() << ") rad/s\n";
+}
+
+void soldier_scenario(random_engine & prand)
+{
+  bullet_world physics;
+  soldier player_body( glm::vec2(0.0f, 0.0f),
+                       projectile::properties(0.008f, 1000.0f), prand );
+  physics.add_body(player_body);
+  physics.add_callback( static_cast<biped &>(player_body) );
+  physics.add_callback( static_cast<shooter &>(player_body),
+                        bullet_world::weapons_phase );
+  std::vector<const body *> bodies(1, &player_body);
+
+  // Targets laid out as in the demo
+  std::vector<biped> targets;
+  static const glm::vec2 start(-6.25f, -6.25f);
+  static const int width = 5;
+  static const int num_targets = 25;
+  static const float spacing = 2.5f;
+  targets.reserve(num_targets);
+  for(int i = 0; i < num_targets; ++i)
+  {
+    targets.emplace_back(
+      start + glm::vec2( spacing*(i%width), spacing*(i/width) )
+    );
+    physics.add_body( targets.back() );
+    bodies.push_back( &targets.back() );
+  }
+
+  player input;
+  measure("soldier_demo", physics, bodies,
+    [&]()
+    {
+      wander(input, prand);
+      input.apply_input(player_body);
+      player_body.weapon.step( physics.substep() );
+    }
+  );
+}
+
+void ship_scenario(random_engine & prand)
+{
+  bullet_world physics;
+  warship player_body( compose_transform(glm::vec2(0.0f, 0.0f)), prand );
+  const projectile::properties test_bullet(0.008f, 1000.0f);
+  player_body.weapon_tree.weapons.emplace_back(
+    glm::vec2(0.0f,  0.25f), test_bullet
+  );
+  player_body.weapon_tree.weapons.emplace_back(
+    glm::vec2(0.0f, -0.25f), test_bullet
+  );
+  ship opponent( compose_transform(glm::vec2(60.0f, 60.0f)) );
+  physics.add_body(player_body);
+  physics.add_body(opponent);
+  physics.add_callback(player_body);
+
+  // Obstacles laid out as in the demo
+  static const btBox2dShape square( btVector3(1.0f, 1.0f, 1.0f) );
+  static_geometry obstacles;
+  for(int x = 0; x < 12; ++x)
+    for(int y = 0; y < 12; ++y)
+      obstacles.add( square, compose_transform(
+        glm::vec2(-55.0f, -55.0f) + glm::vec2(x*10.0f, y*10.0f)
+      ) );
+  physics.add_body(obstacles);
+
+  std::vector<const body *> bodies = {&player_body, &opponent, &obstacles};
+  player input;
+  measure("ship_demo", physics, bodies,
+    [&]()
+    {
+      wander(input, prand);
+      input.apply_input(player_body);
+    }
+  );
+}
+
+int main()
+{
+  random_engine prand(1);
+  std::cout << std::setw(14) << "scenario" << std::setw(10) << "entities"
+            << std::setw(8) << "mat3" << std::setw(8) << "full"
+            << std::setw(10) << "delta" << std::setw(10) << "lagged"
+            << "  (bytes per entity per tick)\n";
+  soldier_scenario(prand);
+  ship_scenario(prand);
+}
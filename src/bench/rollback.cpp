@@ -0,0 +1,83 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+// Checks that rollback resimulates exactly. Two deterministic arenas play
+// the same game and both save at the same tick; one carries on, the other
+// plays different input for a while, restores and catches up. Exits with 1
+// if their state hashes differ afterwards.
+
+
+#include "arena.h"
+#include <iostream>
+static const int fighters = 32;
+static const int saved_tick = 120;
+static const int mispredicted_ticks = 30;
+static const int final_tick = 300;
+
+// Everyone runs for the middle and fires, or away from it when mispredicting
+static void play(arena & game, bool mispredict)
+{
+  for(auto i = game.fighters().begin(); i != game.fighters().end(); ++i)
+  {
+    player & controls = game.find(i->serial).controls;
+    glm::vec2 position = i->avatar.real_position();
+    glm::vec2 inward = glm::length(position) > 0.1f ?
+                       -glm::normalize(position) : glm::vec2(0.0f, 0.0f);
+    controls.movement = mispredict ? -inward : inward;
+    controls.aim = inward;
+    controls.fire = !mispredict;
+  }
+  game.tick();
+}
+
+int main()
+{
+  world_options options;
+  options.deterministic = true;
+  arena uninterrupted(1, options), restored(1, options);
+  for(int i = 0; i != fighters; ++i)
+  {
+    uninterrupted.spawn();
+    restored.spawn();
+  }
+
+  world_snapshot unused, snapshot;
+  for(int tick = 0; tick != saved_tick; ++tick)
+  {
+    play(uninterrupted, false);
+    play(restored, false);
+  }
+  // Saving resets contact state in deterministic worlds, so both save
+  uninterrupted.world().save(unused);
+  restored.world().save(snapshot);
+
+  for(int tick = 0; tick != mispredicted_ticks; ++tick)
+    play(restored, true);
+  restored.world().restore(snapshot);
+
+  for(int tick = saved_tick; tick != final_tick; ++tick)
+  {
+    play(uninterrupted, false);
+    play(restored, false);
+  }
+  bool same = uninterrupted.world().state_hash() ==
+              restored.world().state_hash();
+  std::cout << "restored at tick " << saved_tick << " after "
+            << mispredicted_ticks << " mispredicted ticks: state at tick "
+            << final_tick << (same ? " matches" : " differs") << std::endl;
+  return same ? 0 : 1;
+}
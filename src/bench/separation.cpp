@@ -0,0 +1,45 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+// Checks that the solver pushes two overlapping bodies apart, with one
+// thread by default or as many as given. Exits with 1 if they're still
+// overlapping after a second.
+
+
+#include "physics.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+int main(int argc, char * argv[])
+{
+  world_options options;
+  if(argc > 1) options.threads = std::max(std::atoi(argv[1]), 1);
+  static const btSphereShape shape(0.5f);
+  bullet_world physics(options);
+  body left( 1.0f, shape, compose_transform( glm::vec2(-0.1f, 0.0f) ) );
+  body right( 1.0f, shape, compose_transform( glm::vec2(0.1f, 0.0f) ) );
+  physics.add_body(left);
+  physics.add_body(right);
+  physics.step_ticks(60);
+  float distance = glm::length( right.real_position() - left.real_position() );
+  physics.remove_body(right);
+  physics.remove_body(left);
+
+  std::cout << options.threads << " thread(s): centres " << distance
+            << " m apart after one second (radii sum to 1 m)" << std::endl;
+  return distance < 0.95f ? 1 : 0;
+}
@@ -0,0 +1,529 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+// Scaling suite: headless scenarios from a hundred to a hundred thousand
+// entities, timing every substep. Prints a table, and JSON for tooling.
+
+
+#include "biped.h"
+#include "ship.h"
+#include "static_geometry.h"
+#include "allocation.h"
+#include "projectile_kernel.h"
+#include "random.h"
+#include <cmath>
+#include <list>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+class scenario
+{
+public:
+  virtual ~scenario() {}
+  // Set controls before a substep
+  virtual void drive(std::uint64_t tick) = 0;
+  // Raycasts the next substep will make
+  virtual std::size_t rays() const
+  {
+    return 0;
+  }
+  std::size_t bodies;
+};
+
+static const projectile::properties bullet_type(0.008f, 1000.0f);
+
+// Bipeds packed about one per square meter, each picking a new direction
+// every half second
+class crowd : public scenario
+{
+public:
+  crowd(bullet_world & physics_, int count)
+  : physics(physics_), prand(1)
+  {
+    float extent = 0.5f*std::sqrt( float(count) );
+    std::uniform_real_distribution<float> place(-extent, extent);
+    for(int i = 0; i < count; ++i)
+    {
+      float x = place(prand);
+      float y = place(prand);
+      bipeds.emplace_back( glm::vec2(x, y) );
+      physics.add_body( bipeds.back() );
+      physics.add_callback( bipeds.back() );
+    }
+    bodies = count;
+  }
+  ~crowd()
+  {
+    for(auto i = bipeds.begin(); i != bipeds.end(); ++i)
+    {
+      physics.remove_callback(*i);
+      physics.remove_body(*i);
+    }
+  }
+  void drive(std::uint64_t tick) override
+  {
+    std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+    int n = 0;
+    for(auto i = bipeds.begin(); i != bipeds.end(); ++i, ++n)
+      // Staggered, so the same share changes course every substep
+      if( (tick + n) % 60 == 0 )
+      {
+        float x = direction(prand);
+        float y = direction(prand);
+        i->force( biped::max_linear_force*glm::vec2(x, y) );
+      }
+  }
+
+private:
+  bullet_world & physics;
+  random_engine prand;
+  std::list<biped> bipeds;
+};
+
+// Ships thrusting forward, steered by rotation_control towards headings
+// that change every second
+class fleet : public scenario
+{
+public:
+  fleet(bullet_world & physics_, int count)
+  : physics(physics_), prand(1)
+  {
+    float extent = 2.0f*std::sqrt( float(count) );
+    std::uniform_real_distribution<float> place(-extent, extent);
+    for(int i = 0; i < count; ++i)
+    {
+      float x = place(prand);
+      float y = place(prand);
+      ships.emplace_back( compose_transform( glm::vec2(x, y) ) );
+      ship & s = ships.back();
+      s.rctrl_active = true;
+      s.rctrl.stop = false;
+      s.force( glm::vec2(0.25f*ship::max_linear_force, 0.0f) );
+      physics.add_body(s);
+      physics.add_callback(s);
+    }
+    bodies = count;
+  }
+  ~fleet()
+  {
+    for(auto i = ships.begin(); i != ships.end(); ++i)
+    {
+      physics.remove_callback(*i);
+      physics.remove_body(*i);
+    }
+  }
+  void drive(std::uint64_t tick) override
+  {
+    std::uniform_real_distribution<float> heading( -glm::pi<float>(),
+                                                   glm::pi<float>() );
+    int n = 0;
+    for(auto i = ships.begin(); i != ships.end(); ++i, ++n)
+      if( (tick + n) % 120 == 0 ) i->rctrl.target = heading(prand);
+  }
+
+private:
+  bullet_world & physics;
+  random_engine prand;
+  std::list<ship> ships;
+};
+
+// Soldiers walking and firing continuously, optionally among a grid of
+// static squares baked into one static_geometry
+class firefight : public scenario
+{
+public:
+  static const btBox2dShape square;
+
+  firefight(bullet_world & physics_, int count, int obstacles = 0)
+  : physics(physics_), prand(1)
+  {
+    // The squares sit 4 m apart, and soldiers share their area
+    int side = static_cast<int>( std::ceil( std::sqrt( float(obstacles) ) ) );
+    for(int i = 0; i < obstacles; ++i)
+      geometry.add( square, compose_transform( glm::vec2(
+        4.0f*(i % side - side/2), 4.0f*(i/side - side/2)
+      ) ) );
+    if(obstacles) physics.add_body(geometry);
+
+    float extent = std::max( 2.0f*std::sqrt( float(count) ), 2.0f*side );
+    std::uniform_real_distribution<float> place(-extent, extent);
+    std::uniform_real_distribution<float> angle( -glm::pi<float>(),
+                                                 glm::pi<float>() );
+    for(int i = 0; i < count; ++i)
+    {
+      float x = place(prand);
+      float y = place(prand);
+      soldiers.emplace_back(glm::vec2(x, y), bullet_type, prand);
+      soldier & s = soldiers.back();
+      s.weapon.target = angle(prand);
+      s.enabled = true;
+      physics.add_body(s);
+      physics.add_callback( static_cast<biped &>(s) );
+      physics.add_callback( static_cast<shooter &>(s),
+                            bullet_world::weapons_phase );
+    }
+    bodies = count + (obstacles ? 1 : 0);
+  }
+  ~firefight()
+  {
+    for(auto i = soldiers.begin(); i != soldiers.end(); ++i)
+    {
+      physics.remove_callback( static_cast<shooter &>(*i) );
+      physics.remove_callback( static_cast<biped &>(*i) );
+      physics.remove_body(*i);
+    }
+    if( geometry.size() ) physics.remove_body(geometry);
+  }
+  void drive(std::uint64_t tick) override
+  {
+    std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> angle( -glm::pi<float>(),
+                                                 glm::pi<float>() );
+    int n = 0;
+    for(auto i = soldiers.begin(); i != soldiers.end(); ++i, ++n)
+    {
+      if( (tick + n) % 60 == 0 )
+      {
+        float x = direction(prand);
+        float y = direction(prand);
+        i->force( 0.5f*biped::max_linear_force*glm::vec2(x, y) );
+        i->weapon.target = angle(prand);
+      }
+      i->weapon.step( physics.substep() );
+    }
+  }
+  std::size_t rays() const override
+  {
+    return physics.projectiles().size();
+  }
+
+private:
+  bullet_world & physics;
+  random_engine prand;
+  static_geometry geometry;
+  std::list<soldier> soldiers;
+};
+const btBox2dShape firefight::square( btVector3(1.0f, 1.0f, 1.0f) );
+
+static std::unique_ptr<scenario> make_scenario
+(const std::string & name, bullet_world & physics, int count)
+{
+  if(name == "crowd")
+    return std::unique_ptr<scenario>( new crowd(physics, count) );
+  if(name == "ships")
+    return std::unique_ptr<scenario>( new fleet(physics, count) );
+  if(name == "firefight")
+    return std::unique_ptr<scenario>( new firefight(physics, count) );
+  if(name == "obstacles")
+    // Mostly map, with a tenth as many soldiers shooting through it
+    return std::unique_ptr<scenario>(
+      new firefight( physics, std::max(count/10, 1), count )
+    );
+  throw std::invalid_argument("no scenario named " + name);
+}
+
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+// Kilobytes, or -1 where unknown. Peak for the whole process so far, so run
+// scenarios largest last, or one per process.
+static long peak_rss_kb()
+{
+#if defined(__unix__) || defined(__APPLE__)
+  rusage usage;
+  if( getrusage(RUSAGE_SELF, &usage) ) return -1;
+#  ifdef __APPLE__
+  return usage.ru_maxrss/1024;
+#  else
+  return usage.ru_maxrss;
+#  endif
+#else
+  return -1;
+#endif
+}
+
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+class result
+{
+public:
+  std::string name;
+  int entities;
+  std::size_t bodies;
+  // Sorted nanoseconds per substep
+  std::vector<double> samples;
+  double mean, seconds;
+  unsigned long long contacts, rays;
+  long peak_rss;
+  // Made by timed steps, if counted
+  unsigned long long allocations;
+
+  double percentile(double p) const
+  {
+    return samples[ static_cast<std::size_t>( p*(samples.size() - 1) ) ];
+  }
+};
+
+// Touching pairs per entity to preallocate contacts for. Dense crowds reach
+// about three, so new pairs don't fall back to the heap mid-run.
+static const int contacts_per_entity = 8;
+
+static result run(const std::string & name, int count, int warmup, int steps,
+                  world_options options)
+{
+  typedef std::chrono::duration<double, std::nano> double_nanoseconds;
+  options.contact_pool_size = std::max(options.contact_pool_size,
+                                       contacts_per_entity*count);
+  bullet_world physics(options);
+  std::unique_ptr<scenario> s = make_scenario(name, physics, count);
+  for(int i = 0; i < warmup; ++i)
+  {
+    s->drive( physics.tick() );
+    physics.step_ticks(1);
+  }
+
+  result r;
+  r.name = name;
+  r.entities = count;
+  r.bodies = s->bodies;
+  r.samples.reserve(steps);
+  r.contacts = r.rays = 0;
+  unsigned long long allocated = physics.stats().allocations;
+  double total = 0.0;
+  for(int i = 0; i < steps; ++i)
+  {
+    s->drive( physics.tick() );
+    r.rays += s->rays();
+    auto start = std::chrono::steady_clock::now();
+    physics.step_ticks(1);
+    double_nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+    r.samples.push_back( elapsed.count() );
+    total += elapsed.count();
+    const std::vector<contact_event> & contacts = physics.contacts();
+    for(auto c = contacts.begin(); c != contacts.end(); ++c)
+      if(c->state != contact_event::end) ++r.contacts;
+  }
+  r.allocations = physics.stats().allocations - allocated;
+  std::sort( r.samples.begin(), r.samples.end() );
+  r.mean = total/steps;
+  r.seconds = total*1e-9;
+  r.peak_rss = peak_rss_kb();
+  return r;
+}
+
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+static void write_json(std::ostream & out, const std::vector<result> & results,
+                       const world_options & options, int steps)
+{
+  out << "{\n  \"threads\": " << options.threads
+      << ",\n  \"grid_cell_size\": " << options.grid_cell_size
+      << ",\n  \"substeps\": " << steps << ",\n  \"results\": [";
+  for(auto r = results.begin(); r != results.end(); ++r)
+  {
+    out << (r == results.begin() ? "\n" : ",\n")
+        << "    {\"scenario\": \"" << r->name << "\", \"entities\": "
+        << r->entities << ", \"bodies\": " << r->bodies
+        << ",\n     \"ns_per_substep\": {\"mean\": " << r->mean
+        << ", \"p50\": " << r->percentile(0.5)
+        << ", \"p99\": " << r->percentile(0.99)
+        << ", \"max\": " << r->samples.back() << "},\n"
+        << "     \"histogram\": [";
+    // Power of two buckets: counts of substeps taking under each bound
+    double bound = 1024.0;
+    bool first = true;
+    for(auto i = r->samples.begin(); i != r->samples.end(); bound *= 2.0)
+    {
+      auto end = std::lower_bound(i, r->samples.end(), bound);
+      if(end != i)
+      {
+        out << (first ? "" : ", ") << "{\"lt_ns\": " << bound
+            << ", \"count\": " << (end - i) << '}';
+        first = false;
+      }
+      i = end;
+    }
+    out << "],\n     \"bodies_per_s\": "
+        << r->bodies*r->samples.size()/r->seconds
+        << ", \"contacts_per_s\": " << r->contacts/r->seconds
+        << ", \"rays_per_s\": " << r->rays/r->seconds
+        << ", \"allocations\": " << r->allocations
+        << ", \"peak_rss_kb\": ";
+    if(r->peak_rss < 0) out << "null";
+    else out << r->peak_rss;
+    out << '}';
+  }
+  out << "\n  ]\n}" << std::endl;
+}
+
+#include <sstream>
+static std::vector<int> parse_counts(const char * list)
+{
+  std::vector<int> counts;
+  std::istringstream in(list);
+  std::string item;
+  while( std::getline(in, item, ',') )
+  {
+    int count = std::stoi(item);
+    if(count <= 0) throw std::invalid_argument("counts must be positive");
+    counts.push_back(count);
+  }
+  return counts;
+}
+
+#include <cstring>
+static projectile_kernel::path kernel_path(const char * name)
+{
+  const projectile_kernel::path paths[] = {
+    projectile_kernel::scalar, projectile_kernel::sse2, projectile_kernel::avx
+  };
+  for(projectile_kernel::path p : paths)
+    if( !std::strcmp(name, projectile_kernel::name(p)) ) return p;
+  throw std::invalid_argument( std::string("no projectile kernel ") + name );
+}
+int main(int argc, char * argv[])
+{
+  const char * usage_message =
+    "Usage: tdse_bench [options]\n"
+    "  --scenario NAME  crowd, ships, firefight, obstacles or all (default)\n"
+    "  --counts LIST    comma separated entity counts\n"
+    "                   (default 100,1000,10000,100000)\n"
+    "  --steps N        timed substeps per run (default 200)\n"
+    "  --warmup N       untimed substeps first (default 20)\n"
+    "  --threads N      physics worker threads (default 1)\n"
+    "  --grid SIZE      use grid_broadphase with this cell size\n"
+    "  --kernel PATH    projectile kernel: scalar, sse2 or avx\n"
+    "                   (default: the fastest supported)\n"
+    "  --json FILE      also write results as JSON; - for stdout\n"
+    "  --check-allocations\n"
+    "                   count heap allocations in timed substeps, and fail\n"
+    "                   if there are any (use a warmup longer than\n"
+    "                   projectile lifetimes, e.g. 300). Skips obstacles\n"
+    "                   unless named, since Bullet's compound shape ray\n"
+    "                   test allocates on every call";
+
+  try
+  {
+    std::vector<std::string> names = {"crowd", "ships", "firefight",
+                                      "obstacles"};
+    std::vector<int> counts = {100, 1000, 10000, 100000};
+    int steps = 200, warmup = 20;
+    world_options options;
+    const char * json_path = nullptr;
+    bool check_allocations = false, named = false;
+    for(int i = 1; i < argc; ++i)
+    {
+      bool has_value = i + 1 < argc;
+      if( !std::strcmp(argv[i], "--scenario") && has_value )
+      {
+        std::string name = argv[++i];
+        if(name != "all")
+        {
+          names.assign(1, name);
+          named = true;
+        }
+      }
+      else if( !std::strcmp(argv[i], "--counts") && has_value )
+        counts = parse_counts(argv[++i]);
+      else if( !std::strcmp(argv[i], "--steps") && has_value )
+        steps = std::max(std::stoi(argv[++i]), 1);
+      else if( !std::strcmp(argv[i], "--warmup") && has_value )
+        warmup = std::max(std::stoi(argv[++i]), 0);
+      else if( !std::strcmp(argv[i], "--threads") && has_value )
+        options.threads = std::max(std::stoi(argv[++i]), 1);
+      else if( !std::strcmp(argv[i], "--grid") && has_value )
+        options.grid_cell_size = std::stof(argv[++i]);
+      else if( !std::strcmp(argv[i], "--kernel") && has_value )
+        projectile_kernel::select( kernel_path(argv[++i]) );
+      else if( !std::strcmp(argv[i], "--json") && has_value )
+        json_path = argv[++i];
+      else if( !std::strcmp(argv[i], "--check-allocations") )
+        check_allocations = true;
+      else
+      {
+        std::cout << usage_message << std::endl;
+        return 1;
+      }
+    }
+    if(check_allocations)
+    {
+      // btCompoundShape ray tests fill a heap allocated stack each call, so
+      // obstacles can't pass
+      if(!named) names.erase( std::find(names.begin(), names.end(),
+                                        "obstacles") );
+      allocation_counter::install();
+    }
+    // Results go to stdout as JSON alone, so the table moves to stderr
+    bool json_stdout = json_path && !std::strcmp(json_path, "-");
+    std::ostream & table = json_stdout ? std::cerr : std::cout;
+
+    table << std::setw(10) << "scenario" << std::setw(8) << "count"
+          << std::setw(12) << "ns mean" << std::setw(12) << "ns p50"
+          << std::setw(12) << "ns p99" << std::setw(13) << "bodies/s"
+          << std::setw(13) << "contacts/s" << std::setw(13) << "rays/s"
+          << std::setw(10) << "peak MB";
+    if(check_allocations) table << std::setw(10) << "allocs";
+    table << '\n';
+    bool allocated = false;
+    std::vector<result> results;
+    for(auto name = names.begin(); name != names.end(); ++name)
+      for(int count : counts)
+      {
+        results.push_back( run(*name, count, warmup, steps, options) );
+        const result & r = results.back();
+        table << std::setw(10) << r.name << std::setw(8) << r.entities
+              << std::setw(12) << std::fixed << std::setprecision(0)
+              << r.mean << std::setw(12) << r.percentile(0.5)
+              << std::setw(12) << r.percentile(0.99)
+              << std::setw(13) << r.bodies*r.samples.size()/r.seconds
+              << std::setw(13) << r.contacts/r.seconds
+              << std::setw(13) << r.rays/r.seconds
+              << std::setw(10) << std::setprecision(1);
+        if(r.peak_rss < 0) table << '-';
+        else table << r.peak_rss/1024.0;
+        if(check_allocations) table << std::setw(10) << r.allocations;
+        table << std::endl;
+        if(r.allocations) allocated = true;
+        table << std::defaultfloat << std::setprecision(6);
+      }
+
+    if(json_stdout) write_json(std::cout, results, options, steps);
+    else if(json_path)
+    {
+      std::ofstream json(json_path);
+      if(!json)
+        throw std::runtime_error( std::string("can't create ") + json_path );
+      write_json(json, results, options, steps);
+    }
+    if(check_allocations && allocated)
+    {
+      std::cerr << "steady state steps allocated" << std::endl;
+      return 1;
+    }
+  }
+  catch(const std::exception & e)
+  {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+}
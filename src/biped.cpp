@@ -47,6 +47,15 @@ void biped::force(const glm::vec2 & force__)
   else force_ = force__*(max_linear_force/mag);
 }
 
+void biped::save(world_snapshot & snapshot) const
+{
+  snapshot.write(force_);
+}
+void biped::restore(world_snapshot & snapshot)
+{
+  snapshot.read(force_);
+}
+
 void biped::presubstep(bullet_world & world, float_seconds substep_time)
 {
   if(force_.x != 0.0f || force_.y != 0.0f)
@@ -68,21 +77,38 @@ void biped::presubstep(bullet_world & world, float_seconds substep_time)
 
 soldier::soldier(const glm::vec2 & position,
                  const projectile::properties & bullet_type_,
-                 std::default_random_engine & prand)
+                 random_engine & prand)
 : biped(position),
   shooter( std::chrono::milliseconds(120) ),
   bullet_type(bullet_type_),
   weapon(8.0f),
-  prand_(prand)
+  prand_( prand() ),
+  spread(0.0f, 0.02f)
 {}
 
-std::normal_distribution<float> soldier::normal_dist(0.0f, 0.02f);
+void soldier::save(world_snapshot & snapshot) const
+{
+  biped::save(snapshot);
+  shooter::save(snapshot);
+  snapshot.write(weapon.aim_angle);
+  snapshot.write(weapon.target);
+  snapshot.write(prand_);
+}
+void soldier::restore(world_snapshot & snapshot)
+{
+  biped::restore(snapshot);
+  shooter::restore(snapshot);
+  snapshot.read(weapon.aim_angle);
+  snapshot.read(weapon.target);
+  snapshot.read(prand_);
+}
+
 projectile soldier::fire()
 {
   glm::vec2 velocity(400.0f, 0.0f);
   glm::mat2 direction = mat2_from_angle(
     weapon.aim_angle +
-    normal_dist(prand_)
+    spread(prand_)
   );
   return projectile(
     bullet_type,
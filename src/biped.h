@@ -23,7 +23,7 @@ with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
 #include <BulletCollision/CollisionShapes/btSphereShape.h>
 
 
-class biped : public actor, public needs_presubstep
+class biped : public actor, public needs_presubstep, public needs_snapshot
 {
 public:
   static constexpr float size = 0.25f;
@@ -37,6 +37,9 @@ public:
   const glm::vec2 & force() const;
   void force(const glm::vec2 & f);
 
+  void save(world_snapshot & snapshot) const override;
+  void restore(world_snapshot & snapshot) override;
+
 protected:
   void presubstep(bullet_world & world, float_seconds substep_time) override;
 
@@ -45,7 +48,7 @@ private:
 };
 
 
-#include <random>
+#include "random.h"
 #include "turret.h"
 #include "shooter.h"
 class soldier : public biped, public shooter
@@ -53,16 +56,21 @@ class soldier : public biped, public shooter
 public:
   soldier(const glm::vec2 & position,
           const projectile::properties & bullet_type_,
-          std::default_random_engine & prand);
+          random_engine & prand);
   soldier(const soldier &) = delete;
   void operator=(const soldier &) = delete;
 
   projectile::properties bullet_type;
   turret weapon;
 
+  void save(world_snapshot & snapshot) const override;
+  void restore(world_snapshot & snapshot) override;
+
 private:
-  std::default_random_engine & prand_;
-  static std::normal_distribution<float> normal_dist;
+  // Each soldier draws from its own stream, seeded from the engine passed
+  // to the constructor, so results don't depend on other entities' shots
+  random_engine prand_;
+  normal_variate spread;
 
 protected:
   projectile fire() override;
@@ -18,65 +18,49 @@ with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
 
 
 #include <array>
-#include "physics.h"
-class obstacle : public body
-{
-public:
-  static const std::array<glm::vec2, 4> square_vertices;
-  static const btConvexHullShape square_prism;
-  static const btConvex2dShape square;
-
-  obstacle(const glm::vec2 & position);
-};
-const std::array<glm::vec2, 4> obstacle::square_vertices =
-{
-  glm::vec2(1.0f, 1.0f),
-  glm::vec2(-1.0f, 1.0f),
-  glm::vec2(-1.0f, -1.0f),
-  glm::vec2(1.0f, -1.0f)
-};
-const btConvexHullShape obstacle::square_prism =
-  make_convex_hull(square_vertices);
-const btConvex2dShape obstacle::square(
-  const_cast<btConvexHullShape *>(&square_prism)
-);
-obstacle::obstacle(const glm::vec2 & position)
-: body( 0.0f, square, compose_transform(position) )
-{}
 #include <vector>
+#include "static_geometry.h"
 class obstacle_grid
 {
 public:
+  static const btBox2dShape square;
+
   obstacle_grid( const glm::vec2 & origin,
                  const glm::ivec2 & size,
                  const glm::vec2 & spacing = glm::vec2(10.0f, 10.0f) );
   void add_all(bullet_world & physics);
   void remove_all(bullet_world & physics);
 
-  const std::vector<obstacle> & obstacles;
+  const std::vector<glm::mat3> & models;
 
 private:
-  std::vector<obstacle> obstacles_;
+  std::vector<glm::mat3> models_;
+  // Every square baked into one collision object
+  static_geometry geometry;
 };
+const btBox2dShape obstacle_grid::square( btVector3(1.0f, 1.0f, 1.0f) );
 obstacle_grid::obstacle_grid(const glm::vec2 & origin,
                              const glm::ivec2 & size,
                              const glm::vec2 & spacing)
-: obstacles(obstacles_)
+: models(models_)
 {
-  obstacles_.reserve(size.x*size.y);
+  models_.reserve(size.x*size.y);
   for(int x = 0; x < size.x; ++x)
     for(int y = 0; y < size.y; ++y)
-      obstacles_.emplace_back( origin + glm::vec2(x*spacing.x, y*spacing.y) );
+    {
+      models_.push_back( compose_transform(
+        origin + glm::vec2(x*spacing.x, y*spacing.y)
+      ) );
+      geometry.add( square, models_.back() );
+    }
 }
 void obstacle_grid::add_all(bullet_world & physics)
 {
-  for(auto i = obstacles_.begin(); i != obstacles_.end(); ++i)
-    physics.add_body(*i);
+  physics.add_body(geometry);
 }
 void obstacle_grid::remove_all(bullet_world & physics)
 {
-  for(auto i = obstacles_.begin(); i != obstacles_.end(); ++i)
-    physics.remove_body(*i);
+  physics.remove_body(geometry);
 }
 
 
@@ -110,6 +94,9 @@ private:
 #include <glm/gtc/constants.hpp>
 #include "player.h"
 #include "shape_renderer.h"
+// Projectile paths to draw. Each demo reuses one every frame, so drawing
+// doesn't allocate once it has grown.
+typedef std::vector<segment> segment_buffer;
 void soldier_demo()
 {
   try
@@ -119,7 +106,7 @@ void soldier_demo()
       std::random_device r;
       seed = r();
     }
-    std::default_random_engine prand(seed);
+    random_engine prand(seed);
     bullet_world physics;
     soldier player_body(glm::vec2(0.0f, 0.0f),
                         projectile::properties(0.008f, 1000.0f),
@@ -130,7 +117,8 @@ void soldier_demo()
     // Apply movement controls in between substeps
     physics.add_callback( static_cast<biped &>(player_body) );
     // Create and manage projectiles in between substeps
-    physics.add_callback( static_cast<shooter &>(player_body) );
+    physics.add_callback( static_cast<shooter &>(player_body),
+                          bullet_world::weapons_phase );
 
     // Instantiate targets to shoot at
     std::vector<biped> test_bipeds;
@@ -171,38 +159,44 @@ void soldier_demo()
       circle_indices[i] = i;
     shape test_biped_shape(circle_vertices, circle_indices, GL_LINE_LOOP);
 
+    segment_buffer psegments;
     bool quit = false;
     lap_timer timer;
     while(!quit)
     {
+      // Draw bodies between the last two substeps for smooth motion
+      float alpha = physics.alpha();
+      glm::mat3 player_model = player_body.interpolated_model(alpha);
+      glm::vec2 player_position(player_model[2]);
+
       // Calculate turret appearance
       float turret_aim = player_body.weapon.aim_angle;
       glm::vec2 turret_end( biped::size*glm::cos(turret_aim),
         biped::size*glm::sin(turret_aim) );
-      segment turret_segment( player_body.position() );
+      segment turret_segment(player_position);
       turret_segment.end = turret_segment.start + turret_end;
 
       // Calculate segments from projectiles
-      std::vector<segment> psegments;
-      for(auto i = player_body.projectiles.begin();
-          i != player_body.projectiles.end();
-          ++i)
-        psegments.emplace_back(
-          i->position(),
-          i->position() - 0.01f*i->velocity()
-        );
+      psegments.clear();
+      const projectile_pool & shots = physics.projectiles().shots();
+      for(std::size_t i = 0; i != shots.size(); ++i)
+        if( shots.owner(i) == &player_body )
+          psegments.emplace_back(
+            shots.position(i),
+            shots.position(i) - 0.01f*shots.velocity(i)
+          );
 
       // Set camera to follow player object
-      player_io.view.position = player_body.position();
+      player_io.view.position = player_position;
       // Synchronize view with the camera
       ren.view( player_io.view.view() );
       // Clear screen
       ren.clear();
       // Draw the player
-      ren.render(player_body.model(), test_biped_shape);
+      ren.render(player_model, test_biped_shape);
       // Draw the target bipeds
       for(auto i = test_bipeds.begin(); i != test_bipeds.end(); ++i)
-        ren.render(i->model(), test_biped_shape);
+        ren.render(i->interpolated_model(alpha), test_biped_shape);
       // Draw the player's weapon direction
       ren.render(turret_segment);
       // Draw projectiles in-flight
@@ -248,7 +242,7 @@ void ship_demo()
       std::random_device r;
       seed = r();
     }
-    std::default_random_engine prand(seed);
+    random_engine prand(seed);
     bullet_world physics;
     ship opponent( compose_transform(glm::vec2(60.0f, 60.0f)) );
 
@@ -295,38 +289,37 @@ void ship_demo()
       triangle_indices[i] = i;
     shape ship_shape(ship::triangle_vertices, triangle_indices, GL_LINE_LOOP);
 
+    segment_buffer psegments;
     bool quit = false;
     lap_timer timer;
     while(!quit)
     {
       // Calculate segments from projectiles
-      std::vector<segment> psegments;
-      for(auto i = player_body.projectiles.begin();
-          i != player_body.projectiles.end();
-          ++i)
-        psegments.emplace_back(
-          i->position(),
-          i->position() - 0.01f*i->velocity()
-        );
+      psegments.clear();
+      const projectile_pool & shots = physics.projectiles().shots();
+      for(std::size_t i = 0; i != shots.size(); ++i)
+        if( shots.owner(i) == &player_body )
+          psegments.emplace_back(
+            shots.position(i),
+            shots.position(i) - 0.01f*shots.velocity(i)
+          );
+
+      // Draw bodies between the last two substeps for smooth motion
+      float alpha = physics.alpha();
+      glm::mat3 player_model = player_body.interpolated_model(alpha);
 
       // Set camera to follow player object
-      player_io.view.position = player_body.position();
+      player_io.view.position = glm::vec2(player_model[2]);
       // Synchronize view with the camera
       ren.view( player_io.view.view() );
       // Clear screen
       ren.clear();
       // Draw the player
-      ren.render(player_body.model(), ship_shape);
+      ren.render(player_model, ship_shape);
       // Draw opponent
-      ren.render(opponent.model(), ship_shape);
+      ren.render(opponent.interpolated_model(alpha), ship_shape);
       // Draw obstacles
-      std::vector<glm::mat3> models;
-      models.reserve( squares.obstacles.size() );
-      for(auto i = squares.obstacles.begin();
-          i < squares.obstacles.end();
-          ++i)
-        models.push_back( i->model() );
-      ren.render(models, square_shape);
+      ren.render(squares.models, square_shape);
       // Draw projectiles in-flight
       ren.render(psegments);
       // Flip all drawings to the screen
@@ -1,45 +1,6 @@
 #include "player.h"
 
 
-player::player()
-: movement(0.0f, 0.0f),
-  aim(0.0f),
-  fire(false)
-{}
-void player::apply_input(ship & subject)
-{
-  subject.force( glm::vec2(movement.y*ship::max_linear_force, 0.0f) );
-  if(movement.x == 0.0f)
-  {
-    subject.rctrl.stop = true;
-    subject.rctrl_active = true;
-  }
-  else
-  {
-    subject.torque(-movement.x*ship::max_torque);
-    subject.rctrl_active = false;
-  }
-}
-void player::apply_input(warship & subject)
-{
-  apply_input( static_cast<ship &>(subject) );
-  subject.weapon_tree.fire(fire);
-}
-void player::apply_input(biped & subject)
-{
-  subject.force( glm::vec2(
-    movement.x*biped::max_linear_force,
-    movement.y*biped::max_linear_force
-  ) );
-}
-void player::apply_input(soldier & subject)
-{
-  apply_input( static_cast<biped &>(subject) );
-  subject.weapon.target = glm::atan(aim.y, aim.x);
-  subject.enabled = fire;
-}
-
-
 local_player::local_player(sdl & media_layer)
 : interface( media_layer, "TDSE demo", glm::ivec2(640, 480) ),
   view(glm::vec2(0.0f, 0.0f), 0.0f, 40.0f)
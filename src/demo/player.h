@@ -2,22 +2,7 @@
 #define PLAYER_H_INCLUDED
 
 
-#include "biped.h"
-#include "ship.h"
-class player
-{
-public:
-  player();
-  void apply_input(ship & subject);
-  void apply_input(warship & subject);
-  void apply_input(biped & subject);
-  void apply_input(soldier & subject);
-
-  glm::vec2 movement, aim;
-  bool fire;
-};
-
-
+#include "input.h"
 #include <random>
 #include "window.h"
 #include "camera.h"
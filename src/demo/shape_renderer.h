@@ -20,6 +20,7 @@ with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
 
 
 #include "graphics.h"
+#include <array>
 
 
 class segment
@@ -146,11 +147,12 @@ template<typename T> void shape_renderer::render(const T & segments)
 void shape_renderer::render(const glm::mat3 & transform,
   const shape & m)
 {
-  render(std::vector<glm::mat3>(1, transform), m);
+  // One element arrays draw through the same code without allocating
+  render(std::array<glm::mat3, 1>{ {transform} }, m);
 }
 void shape_renderer::render(const segment & s)
 {
-  render(std::vector<segment>(1, s));
+  render(std::array<segment, 1>{ {s} });
 }
 
 
@@ -0,0 +1,409 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#include "grid_broadphase.h"
+#include <LinearMath/btAabbUtil2.h>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+
+bool grid_broadphase::cell_range::contains(int x, int y) const
+{
+  return x >= min_x && x <= max_x && y >= min_y && y <= max_y;
+}
+bool grid_broadphase::cell_range::operator != (const cell_range & other) const
+{
+  return min_x != other.min_x || min_y != other.min_y ||
+         max_x != other.max_x || max_y != other.max_y;
+}
+int grid_broadphase::cell_range::cells() const
+{
+  // Ranges are clamped well inside int, so this can only saturate
+  long long cells = (max_x - (long long)min_x + 1)*(max_y - (long long)min_y + 1);
+  return cells > max_cells ? max_cells + 1 : int(cells);
+}
+
+
+grid_broadphase::proxy::proxy(const btVector3 & aabb_min,
+                              const btVector3 & aabb_max,
+                              void * user, int group, int mask)
+: btBroadphaseProxy(aabb_min, aabb_max, user, group, mask),
+  oversized(false),
+  moved(false)
+{}
+
+
+grid_broadphase::grid_broadphase(float cell_size__)
+: cell_size_(cell_size__),
+  next_uid(1)
+{
+  if(cell_size_ <= 0.0f)
+    throw std::invalid_argument("cell size must be greater than zero");
+}
+grid_broadphase::~grid_broadphase()
+{
+  // The world normally destroys every proxy first; free any left behind.
+  // Each proxy is deleted from the first cell it occupies.
+  for(auto i = cells.begin(); i != cells.end(); ++i)
+    for(auto p = i->second.begin(); p != i->second.end(); ++p)
+      if( key( (*p)->range.min_x, (*p)->range.min_y ) == i->first )
+        delete *p;
+  for(auto p = oversized.begin(); p != oversized.end(); ++p)
+    delete *p;
+}
+
+float grid_broadphase::cell_size() const
+{
+  return cell_size_;
+}
+
+
+btBroadphaseProxy * grid_broadphase::createProxy(const btVector3 & aabb_min,
+                                                 const btVector3 & aabb_max,
+                                                 int shape_type, void * user,
+                                                 int group, int mask,
+                                                 btDispatcher * dispatcher)
+{
+  proxy * p = new proxy(aabb_min, aabb_max, user, group, mask);
+  p->m_uniqueId = next_uid++;
+  p->range = range_of(aabb_min, aabb_max);
+  insert(*p);
+  p->moved = true;
+  moved.push_back(p);
+  return p;
+}
+void grid_broadphase::destroyProxy(btBroadphaseProxy * base,
+                                   btDispatcher * dispatcher)
+{
+  proxy & p = static_cast<proxy &>(*base);
+  erase(p);
+  if(p.moved) moved.erase( std::find(moved.begin(), moved.end(), &p) );
+  pairs.removeOverlappingPairsContainingProxy(&p, dispatcher);
+  delete &p;
+}
+void grid_broadphase::setAabb(btBroadphaseProxy * base,
+                              const btVector3 & aabb_min,
+                              const btVector3 & aabb_max,
+                              btDispatcher * dispatcher)
+{
+  proxy & p = static_cast<proxy &>(*base);
+  // The world refreshes every AABB each step, most of which are unchanged
+  if(p.m_aabbMin == aabb_min && p.m_aabbMax == aabb_max) return;
+
+  p.m_aabbMin = aabb_min;
+  p.m_aabbMax = aabb_max;
+  cell_range range = range_of(aabb_min, aabb_max);
+  if(range != p.range)
+  {
+    erase(p);
+    p.range = range;
+    insert(p);
+  }
+  if(!p.moved)
+  {
+    p.moved = true;
+    moved.push_back(&p);
+  }
+}
+void grid_broadphase::getAabb(btBroadphaseProxy * base, btVector3 & aabb_min,
+                              btVector3 & aabb_max) const
+{
+  aabb_min = base->m_aabbMin;
+  aabb_max = base->m_aabbMax;
+}
+
+
+void grid_broadphase::rayTest(const btVector3 & from, const btVector3 & to,
+                              btBroadphaseRayCallback & callback,
+                              const btVector3 & aabb_min,
+                              const btVector3 & aabb_max)
+{
+  // Convex sweeps carry a box along the ray; walk every cell it touches
+  if( !aabb_min.isZero() || !aabb_max.isZero() )
+  {
+    swept_test(from, to, callback, aabb_min, aabb_max);
+    return;
+  }
+
+  auto test = [&](proxy & p)
+  {
+    btVector3 bounds[2] = {p.m_aabbMin, p.m_aabbMax};
+    btScalar lambda;
+    if( btRayAabb2(from, callback.m_rayDirectionInverse, callback.m_signs,
+                   bounds, lambda, 0.0f, callback.m_lambda_max) )
+      callback.process(&p);
+  };
+  for(auto i = oversized.begin(); i != oversized.end(); ++i)
+    test(**i);
+
+  // Walk the cells under the ray in order (Amanatides & Woo)
+  float from_x = from.getX()/cell_size_, from_y = from.getY()/cell_size_;
+  float to_x = to.getX()/cell_size_, to_y = to.getY()/cell_size_;
+  cell_range ends = range_of(from, from);
+  int x = ends.min_x, y = ends.min_y;
+  ends = range_of(to, to);
+  int steps = std::abs(ends.min_x - x) + std::abs(ends.min_y - y);
+
+  float dx = to_x - from_x, dy = to_y - from_y;
+  int step_x = dx < 0.0f ? -1 : 1, step_y = dy < 0.0f ? -1 : 1;
+  float delta_x = dx != 0.0f ? std::abs(1.0f/dx) : BT_LARGE_FLOAT;
+  float delta_y = dy != 0.0f ? std::abs(1.0f/dy) : BT_LARGE_FLOAT;
+  float next_x = dx > 0.0f ? (x + 1 - from_x)/dx :
+                 dx < 0.0f ? (x - from_x)/dx : BT_LARGE_FLOAT;
+  float next_y = dy > 0.0f ? (y + 1 - from_y)/dy :
+                 dy < 0.0f ? (y - from_y)/dy : BT_LARGE_FLOAT;
+
+  int last_x = x, last_y = y;
+  for(int i = 0; i <= steps; ++i)
+  {
+    auto cell = cells.find( key(x, y) );
+    if( cell != cells.end() )
+      for(auto p = cell->second.begin(); p != cell->second.end(); ++p)
+        // The ray enters each proxy's cell range once, so only test a proxy
+        // in the first of its cells along the ray
+        if( i == 0 || !(*p)->range.contains(last_x, last_y) )
+          test(**p);
+
+    last_x = x;
+    last_y = y;
+    if(next_x < next_y)
+    {
+      x += step_x;
+      next_x += delta_x;
+    }
+    else
+    {
+      y += step_y;
+      next_y += delta_y;
+    }
+  }
+}
+void grid_broadphase::swept_test(const btVector3 & from, const btVector3 & to,
+                                 btBroadphaseRayCallback & callback,
+                                 const btVector3 & aabb_min,
+                                 const btVector3 & aabb_max)
+{
+  btVector3 sweep_min = from, sweep_max = from;
+  sweep_min.setMin(to);
+  sweep_max.setMax(to);
+  cell_range range = range_of(sweep_min + aabb_min, sweep_max + aabb_max);
+
+  auto test = [&](proxy & p)
+  {
+    // Grow the proxy by the swept box, as btDbvt does
+    btVector3 bounds[2] = {p.m_aabbMin - aabb_max, p.m_aabbMax - aabb_min};
+    btScalar lambda;
+    if( btRayAabb2(from, callback.m_rayDirectionInverse, callback.m_signs,
+                   bounds, lambda, 0.0f, callback.m_lambda_max) )
+      callback.process(&p);
+  };
+  for(auto i = oversized.begin(); i != oversized.end(); ++i)
+    test(**i);
+  for(int x = range.min_x; x <= range.max_x; ++x)
+    for(int y = range.min_y; y <= range.max_y; ++y)
+    {
+      auto cell = cells.find( key(x, y) );
+      if( cell == cells.end() ) continue;
+      for(auto p = cell->second.begin(); p != cell->second.end(); ++p)
+        // Test each proxy only in the first cell it shares with the sweep
+        if( x == std::max(range.min_x, (*p)->range.min_x) &&
+            y == std::max(range.min_y, (*p)->range.min_y) )
+          test(**p);
+    }
+}
+void grid_broadphase::aabbTest(const btVector3 & aabb_min,
+                               const btVector3 & aabb_max,
+                               btBroadphaseAabbCallback & callback)
+{
+  auto test = [&](proxy & p)
+  {
+    if( TestAabbAgainstAabb2(aabb_min, aabb_max, p.m_aabbMin, p.m_aabbMax) )
+      callback.process(&p);
+  };
+  for(auto i = oversized.begin(); i != oversized.end(); ++i)
+    test(**i);
+
+  cell_range range = range_of(aabb_min, aabb_max);
+  if(range.cells() > max_cells)
+  {
+    // Cheaper to visit every occupied cell than every covered one
+    for(auto i = cells.begin(); i != cells.end(); ++i)
+      for(auto p = i->second.begin(); p != i->second.end(); ++p)
+        if( key( (*p)->range.min_x, (*p)->range.min_y ) == i->first )
+          test(**p);
+    return;
+  }
+  for(int x = range.min_x; x <= range.max_x; ++x)
+    for(int y = range.min_y; y <= range.max_y; ++y)
+    {
+      auto cell = cells.find( key(x, y) );
+      if( cell == cells.end() ) continue;
+      for(auto p = cell->second.begin(); p != cell->second.end(); ++p)
+        if( x == std::max(range.min_x, (*p)->range.min_x) &&
+            y == std::max(range.min_y, (*p)->range.min_y) )
+          test(**p);
+    }
+}
+
+
+class stale_pair_filter : public btOverlapCallback
+{
+public:
+  // Returning true removes the pair
+  bool processOverlap(btBroadphasePair & pair) override
+  {
+    const btBroadphaseProxy & p0 = *pair.m_pProxy0, & p1 = *pair.m_pProxy1;
+    return !TestAabbAgainstAabb2(p0.m_aabbMin, p0.m_aabbMax,
+                                 p1.m_aabbMin, p1.m_aabbMax);
+  }
+};
+void grid_broadphase::calculateOverlappingPairs(btDispatcher * dispatcher)
+{
+  if( moved.empty() ) return;
+
+  for(auto i = moved.begin(); i != moved.end(); ++i)
+    find_pairs(**i, dispatcher);
+
+  // Pairs between proxies that stayed put can't have separated, but the
+  // hashed cache has no per-proxy index, so check them all
+  stale_pair_filter filter;
+  pairs.processAllOverlappingPairs(&filter, dispatcher);
+
+  for(auto i = moved.begin(); i != moved.end(); ++i)
+    (*i)->moved = false;
+  moved.clear();
+}
+btOverlappingPairCache * grid_broadphase::getOverlappingPairCache()
+{
+  return &pairs;
+}
+const btOverlappingPairCache * grid_broadphase::getOverlappingPairCache() const
+{
+  return &pairs;
+}
+void grid_broadphase::getBroadphaseAabb(btVector3 & aabb_min,
+                                        btVector3 & aabb_max) const
+{
+  aabb_min.setValue(-BT_LARGE_FLOAT, -BT_LARGE_FLOAT, -BT_LARGE_FLOAT);
+  aabb_max.setValue(BT_LARGE_FLOAT, BT_LARGE_FLOAT, BT_LARGE_FLOAT);
+}
+#include <iostream>
+void grid_broadphase::printStats()
+{
+  std::cout << "grid_broadphase: " << cells.size() << " cells, "
+            << oversized.size() << " oversized proxies, "
+            << pairs.getNumOverlappingPairs() << " pairs" << std::endl;
+}
+void grid_broadphase::resetPool(btDispatcher * dispatcher)
+{
+  if( cells.empty() && oversized.empty() ) next_uid = 1;
+}
+
+
+std::int64_t grid_broadphase::key(int x, int y)
+{
+  return std::int64_t( std::uint64_t( std::uint32_t(x) ) << 32 |
+                       std::uint32_t(y) );
+}
+grid_broadphase::cell_range grid_broadphase::range_of
+(const btVector3 & aabb_min, const btVector3 & aabb_max) const
+{
+  // Clamp so infinite or enormous boxes still produce sane cell indices
+  static constexpr float limit = 1 << 30;
+  auto cell = [this](float coordinate)
+  {
+    float index = std::floor(coordinate/cell_size_);
+    return int( std::max( -limit, std::min(index, limit) ) );
+  };
+  cell_range range;
+  range.min_x = cell( aabb_min.getX() );
+  range.min_y = cell( aabb_min.getY() );
+  range.max_x = cell( aabb_max.getX() );
+  range.max_y = cell( aabb_max.getY() );
+  return range;
+}
+void grid_broadphase::insert(proxy & p)
+{
+  p.oversized = p.range.cells() > max_cells;
+  if(p.oversized)
+  {
+    oversized.push_back(&p);
+    return;
+  }
+  for(int x = p.range.min_x; x <= p.range.max_x; ++x)
+    for(int y = p.range.min_y; y <= p.range.max_y; ++y)
+      cells[ key(x, y) ].push_back(&p);
+}
+void grid_broadphase::erase(proxy & p)
+{
+  // Order within a cell doesn't matter, so swap and pop
+  auto remove = [&p](std::vector<proxy *> & list)
+  {
+    auto i = std::find(list.begin(), list.end(), &p);
+    *i = list.back();
+    list.pop_back();
+  };
+  if(p.oversized)
+  {
+    remove(oversized);
+    return;
+  }
+  for(int x = p.range.min_x; x <= p.range.max_x; ++x)
+    for(int y = p.range.min_y; y <= p.range.max_y; ++y)
+    {
+      auto cell = cells.find( key(x, y) );
+      remove(cell->second);
+      // Drop empty cells, or the map grows with every cell ever visited
+      if( cell->second.empty() ) cells.erase(cell);
+    }
+}
+void grid_broadphase::find_pairs(proxy & p, btDispatcher * dispatcher)
+{
+  auto consider = [&](proxy & other)
+  {
+    // When both moved, let the one with the lower id add the pair
+    if( &other == &p || (other.moved && other.m_uniqueId < p.m_uniqueId) )
+      return;
+    if( TestAabbAgainstAabb2(p.m_aabbMin, p.m_aabbMax,
+                             other.m_aabbMin, other.m_aabbMax) )
+      // The cache applies collision filters and ignores duplicates
+      pairs.addOverlappingPair(&p, &other);
+  };
+
+  for(auto i = oversized.begin(); i != oversized.end(); ++i)
+    consider(**i);
+  if(p.oversized)
+  {
+    for(auto i = cells.begin(); i != cells.end(); ++i)
+      for(auto q = i->second.begin(); q != i->second.end(); ++q)
+        if( key( (*q)->range.min_x, (*q)->range.min_y ) == i->first )
+          consider(**q);
+    return;
+  }
+  for(int x = p.range.min_x; x <= p.range.max_x; ++x)
+    for(int y = p.range.min_y; y <= p.range.max_y; ++y)
+    {
+      auto cell = cells.find( key(x, y) );
+      if( cell == cells.end() ) continue;
+      for(auto q = cell->second.begin(); q != cell->second.end(); ++q)
+        // Consider each neighbour once, in the first cell both occupy
+        if( x == std::max(p.range.min_x, (*q)->range.min_x) &&
+            y == std::max(p.range.min_y, (*q)->range.min_y) )
+          consider(**q);
+    }
+}
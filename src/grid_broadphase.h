@@ -0,0 +1,115 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#ifndef GRID_BROADPHASE_H_INCLUDED
+#define GRID_BROADPHASE_H_INCLUDED
+
+
+#include <btBulletCollisionCommon.h>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+
+/*
+ * Broadphase for worlds that live on the XY plane and hold similarly sized
+ * objects. Proxies are hashed into square cells; the z axis is ignored.
+ * Proxies spanning more than max_cells cells (level boundaries, huge static
+ * geometry) are kept on a separate list tested against everything.
+ */
+class grid_broadphase : public btBroadphaseInterface
+{
+public:
+  static constexpr int max_cells = 64;
+
+  grid_broadphase(float cell_size_);
+  ~grid_broadphase();
+  grid_broadphase(const grid_broadphase &) = delete;
+  void operator = (const grid_broadphase &) = delete;
+
+  float cell_size() const;
+
+  btBroadphaseProxy * createProxy(const btVector3 & aabb_min,
+                                  const btVector3 & aabb_max,
+                                  int shape_type, void * user,
+                                  int group, int mask,
+                                  btDispatcher * dispatcher) override;
+  void destroyProxy(btBroadphaseProxy * proxy,
+                    btDispatcher * dispatcher) override;
+  void setAabb(btBroadphaseProxy * proxy, const btVector3 & aabb_min,
+               const btVector3 & aabb_max, btDispatcher * dispatcher) override;
+  void getAabb(btBroadphaseProxy * proxy, btVector3 & aabb_min,
+               btVector3 & aabb_max) const override;
+
+  void rayTest(const btVector3 & from, const btVector3 & to,
+               btBroadphaseRayCallback & callback,
+               const btVector3 & aabb_min = btVector3(0, 0, 0),
+               const btVector3 & aabb_max = btVector3(0, 0, 0)) override;
+  void aabbTest(const btVector3 & aabb_min, const btVector3 & aabb_max,
+                btBroadphaseAabbCallback & callback) override;
+
+  void calculateOverlappingPairs(btDispatcher * dispatcher) override;
+  btOverlappingPairCache * getOverlappingPairCache() override;
+  const btOverlappingPairCache * getOverlappingPairCache() const override;
+  void getBroadphaseAabb(btVector3 & aabb_min,
+                         btVector3 & aabb_max) const override;
+  void printStats() override;
+  // Restarts proxy ids once every proxy is destroyed
+  void resetPool(btDispatcher * dispatcher) override;
+
+private:
+  class cell_range
+  {
+  public:
+    bool contains(int x, int y) const;
+    bool operator != (const cell_range & other) const;
+    int cells() const;
+
+    int min_x, min_y, max_x, max_y;
+  };
+  class proxy : public btBroadphaseProxy
+  {
+  public:
+    proxy(const btVector3 & aabb_min, const btVector3 & aabb_max,
+          void * user, int group, int mask);
+
+    cell_range range;
+    bool oversized;
+    // Set while queued for pair finding
+    bool moved;
+  };
+
+  const float cell_size_;
+  int next_uid;
+  btHashedOverlappingPairCache pairs;
+  std::unordered_map< std::int64_t, std::vector<proxy *> > cells;
+  std::vector<proxy *> oversized;
+  std::vector<proxy *> moved;
+
+  static std::int64_t key(int x, int y);
+  cell_range range_of(const btVector3 & aabb_min,
+                      const btVector3 & aabb_max) const;
+  void insert(proxy & p);
+  void erase(proxy & p);
+  void find_pairs(proxy & p, btDispatcher * dispatcher);
+  void swept_test(const btVector3 & from, const btVector3 & to,
+                  btBroadphaseRayCallback & callback,
+                  const btVector3 & aabb_min, const btVector3 & aabb_max);
+};
+
+
+#endif  // GRID_BROADPHASE_H_INCLUDED
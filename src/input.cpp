@@ -0,0 +1,57 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#include "input.h"
+
+
+player::player()
+: movement(0.0f, 0.0f),
+  aim(0.0f),
+  fire(false)
+{}
+void player::apply_input(ship & subject)
+{
+  subject.force( glm::vec2(movement.y*ship::max_linear_force, 0.0f) );
+  if(movement.x == 0.0f)
+  {
+    subject.rctrl.stop = true;
+    subject.rctrl_active = true;
+  }
+  else
+  {
+    subject.torque(-movement.x*ship::max_torque);
+    subject.rctrl_active = false;
+  }
+}
+void player::apply_input(warship & subject)
+{
+  apply_input( static_cast<ship &>(subject) );
+  subject.weapon_tree.fire(fire);
+}
+void player::apply_input(biped & subject)
+{
+  subject.force( glm::vec2(
+    movement.x*biped::max_linear_force,
+    movement.y*biped::max_linear_force
+  ) );
+}
+void player::apply_input(soldier & subject)
+{
+  apply_input( static_cast<biped &>(subject) );
+  subject.weapon.target = glm::atan(aim.y, aim.x);
+  subject.enabled = fire;
+}
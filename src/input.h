@@ -0,0 +1,39 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#ifndef INPUT_H_INCLUDED
+#define INPUT_H_INCLUDED
+
+
+#include "biped.h"
+#include "ship.h"
+// Controls as a player (local or remote) last set them
+class player
+{
+public:
+  player();
+  void apply_input(ship & subject);
+  void apply_input(warship & subject);
+  void apply_input(biped & subject);
+  void apply_input(soldier & subject);
+
+  glm::vec2 movement, aim;
+  bool fire;
+};
+
+
+#endif  // INPUT_H_INCLUDED
@@ -0,0 +1,163 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#include "interest.h"
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <stdexcept>
+
+
+float view_radius(const glm::vec2 & viewport, float magnification)
+{
+  return glm::length(viewport)/(2*magnification);
+}
+
+
+interest_grid::interest_grid(float cell_size__)
+: cell_size_(cell_size__)
+{
+  if( !(cell_size_ > 0.0f) )
+    throw std::invalid_argument("interest grid cells must have positive size");
+}
+
+float interest_grid::cell_size() const
+{
+  return cell_size_;
+}
+std::size_t interest_grid::size() const
+{
+  return entries.size();
+}
+
+std::int64_t interest_grid::key(int x, int y)
+{
+  // Shifted unsigned, since shifting a negative value is undefined
+  return std::int64_t( std::uint64_t( std::uint32_t(x) ) << 32 |
+                       std::uint32_t(y) );
+}
+int interest_grid::cell_of(float coordinate) const
+{
+  return static_cast<int>( std::floor(coordinate/cell_size_) );
+}
+
+void interest_grid::insert(std::uint32_t id, const glm::vec2 & position)
+{
+  auto inserted = entries.emplace( id, entry() );
+  if(!inserted.second)
+    throw std::invalid_argument("entity is already in the interest grid");
+  add_member( id, position, key( cell_of(position.x), cell_of(position.y) ),
+              inserted.first->second );
+}
+void interest_grid::move(std::uint32_t id, const glm::vec2 & position)
+{
+  entry & e = entries.at(id);
+  std::int64_t cell = key( cell_of(position.x), cell_of(position.y) );
+  if(cell == e.cell)
+  {
+    (*e.members)[e.index].position = position;
+    return;
+  }
+  remove_member(e);
+  add_member(id, position, cell, e);
+}
+void interest_grid::erase(std::uint32_t id)
+{
+  auto found = entries.find(id);
+  if( found == entries.end() ) return;
+  remove_member(found->second);
+  entries.erase(found);
+}
+void interest_grid::add_member(std::uint32_t id, const glm::vec2 & position,
+                               std::int64_t cell, entry & e)
+{
+  e.cell = cell;
+  e.members = &cells[cell];
+  e.index = e.members->size();
+  e.members->push_back( member{id, position} );
+}
+void interest_grid::remove_member(const entry & e)
+{
+  std::vector<member> & members = *e.members;
+  // Fill the hole with the last member
+  if(e.index + 1 != members.size())
+  {
+    members[e.index] = members.back();
+    entries[members[e.index].id].index = e.index;
+  }
+  members.pop_back();
+}
+
+
+interest_set::interest_set(float hysteresis_)
+: hysteresis(hysteresis_)
+{}
+
+void interest_set::update(const interest_grid & grid,
+                          const glm::vec2 & center, float radius)
+{
+  previous_ids.swap(ids);
+  ids.clear();
+  relevant_.clear();
+  const float radius2 = radius*radius;
+  grid.query( center, radius + hysteresis,
+    [&](std::uint32_t id, float distance2)
+    {
+      if( distance2 <= radius2 ||
+          std::binary_search(previous_ids.begin(), previous_ids.end(), id) )
+      {
+        relevant_.push_back( relevant_entity{id, std::sqrt(distance2)} );
+        ids.push_back(id);
+      }
+    }
+  );
+  std::sort( ids.begin(), ids.end() );
+  // Break ties by id so the order doesn't depend on hashing
+  std::sort( relevant_.begin(), relevant_.end(),
+    [](const relevant_entity & a, const relevant_entity & b)
+    {
+      return a.distance < b.distance ||
+             (a.distance == b.distance && a.id < b.id);
+    }
+  );
+
+  entered_.clear();
+  left_.clear();
+  std::set_difference( ids.begin(), ids.end(),
+                       previous_ids.begin(), previous_ids.end(),
+                       std::back_inserter(entered_) );
+  std::set_difference( previous_ids.begin(), previous_ids.end(),
+                       ids.begin(), ids.end(),
+                       std::back_inserter(left_) );
+}
+
+const std::vector<relevant_entity> & interest_set::relevant() const
+{
+  return relevant_;
+}
+bool interest_set::contains(std::uint32_t id) const
+{
+  return std::binary_search(ids.begin(), ids.end(), id);
+}
+const std::vector<std::uint32_t> & interest_set::entered() const
+{
+  return entered_;
+}
+const std::vector<std::uint32_t> & interest_set::left() const
+{
+  return left_;
+}
@@ -0,0 +1,143 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#ifndef INTEREST_H_INCLUDED
+#define INTEREST_H_INCLUDED
+
+
+#include "glm.h"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+
+// Half the diagonal of what a camera shows, given its viewport in pixels and
+// its magnification in pixels per metre
+float view_radius(const glm::vec2 & viewport, float magnification);
+
+
+/*
+ * Entities hashed into square cells by position, for finding what is near a
+ * point in time proportional to what is near it. Moving an entity within
+ * its cell only updates its position. Cells are kept once visited, so moves
+ * between them don't allocate; cell size should be about the view radius.
+ */
+class interest_grid
+{
+public:
+  interest_grid(float cell_size__);
+
+  float cell_size() const;
+  std::size_t size() const;
+
+  // Throws std::invalid_argument if id is already present
+  void insert(std::uint32_t id, const glm::vec2 & position);
+  // Throws std::out_of_range if id isn't present
+  void move(std::uint32_t id, const glm::vec2 & position);
+  void erase(std::uint32_t id);
+
+  // Calls visit(id, squared distance) for every entity within radius of
+  // center, in no particular order
+  template<class Visitor> void query(const glm::vec2 & center, float radius,
+                                     Visitor visit) const;
+
+private:
+  class member
+  {
+  public:
+    std::uint32_t id;
+    glm::vec2 position;
+  };
+  class entry
+  {
+  public:
+    std::int64_t cell;
+    // Map values stay put when the map rehashes
+    std::vector<member> * members;
+    std::size_t index;
+  };
+
+  const float cell_size_;
+  std::unordered_map< std::int64_t, std::vector<member> > cells;
+  std::unordered_map<std::uint32_t, entry> entries;
+
+  static std::int64_t key(int x, int y);
+  int cell_of(float coordinate) const;
+  void remove_member(const entry & e);
+  void add_member(std::uint32_t id, const glm::vec2 & position,
+                  std::int64_t cell, entry & e);
+};
+
+template<class Visitor> void interest_grid::query
+(const glm::vec2 & center, float radius, Visitor visit) const
+{
+  const float radius2 = radius*radius;
+  const int min_x = cell_of(center.x - radius);
+  const int max_x = cell_of(center.x + radius);
+  const int min_y = cell_of(center.y - radius);
+  const int max_y = cell_of(center.y + radius);
+  for(int x = min_x; x <= max_x; ++x)
+    for(int y = min_y; y <= max_y; ++y)
+    {
+      auto found = cells.find( key(x, y) );
+      if( found == cells.end() ) continue;
+      for(auto i = found->second.begin(); i != found->second.end(); ++i)
+      {
+        glm::vec2 offset = i->position - center;
+        float distance2 = glm::dot(offset, offset);
+        if(distance2 <= radius2) visit(i->id, distance2);
+      }
+    }
+}
+
+
+class relevant_entity
+{
+public:
+  std::uint32_t id;
+  float distance;
+};
+
+// One client's view of an interest_grid, kept between updates
+class interest_set
+{
+public:
+  // Relevant entities stay relevant until they are this much further than
+  // the radius, so ones near the edge don't flicker in and out
+  interest_set(float hysteresis_ = 2.0f);
+
+  void update(const interest_grid & grid, const glm::vec2 & center,
+              float radius);
+
+  // Nearest first, which is the order to send them in
+  const std::vector<relevant_entity> & relevant() const;
+  bool contains(std::uint32_t id) const;
+  // Changes made by the latest update, in id order
+  const std::vector<std::uint32_t> & entered() const;
+  const std::vector<std::uint32_t> & left() const;
+
+  const float hysteresis;
+
+private:
+  std::vector<relevant_entity> relevant_;
+  // Sorted
+  std::vector<std::uint32_t> ids, previous_ids;
+  std::vector<std::uint32_t> entered_, left_;
+};
+
+
+#endif  // INTEREST_H_INCLUDED
@@ -46,38 +46,634 @@ btTransform glm2d_to_bt(const glm::mat3 & glmtrans)
 }
 
 
-bullet_components::bullet_components()
-  : dispatcher(&collision_config),
+world_options::world_options()
+: substep(bullet_world::fixed_substep),
+  max_substeps(10),
+  budget(0),
+  threads(1),
+  grid_cell_size(0.0f),
+  deterministic(false),
+  // Bullet's default
+  contact_pool_size(4096)
+{}
+
+
+#include "config.h"
+#include <stdexcept>
+#ifdef TDSE_BULLET_MT
+#include <mutex>
+#include <new>
+#include <LinearMath/btThreads.h>
+#include <BulletCollision/CollisionDispatch/btCollisionDispatcherMt.h>
+#include <BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolverMt.h>
+// Bullet's task scheduler is global, so the first multithreaded world makes
+// one for the whole process and it's never destroyed. Every later one must
+// want the same number of threads.
+static void use_threads(unsigned threads)
+{
+  static std::mutex mutex;
+  static unsigned scheduler_threads = 0;
+  std::lock_guard<std::mutex> lock(mutex);
+  if(scheduler_threads == 0)
+  {
+    btITaskScheduler * scheduler = btCreateDefaultTaskScheduler();
+    if(!scheduler)
+      throw std::runtime_error("Bullet was built without BT_THREADSAFE");
+    scheduler->setNumThreads(threads);
+    btSetTaskScheduler(scheduler);
+    scheduler_threads = threads;
+  }
+  else if(threads != scheduler_threads)
+    throw std::invalid_argument(
+      "multithreaded worlds in one process must use the same thread count"
+    );
+}
+#endif
+static btCollisionDispatcher * make_dispatcher
+(btCollisionConfiguration & config, unsigned threads)
+{
+  if(threads <= 1) return new btCollisionDispatcher(&config);
+#ifdef TDSE_BULLET_MT
+  use_threads(threads);
+  return new btCollisionDispatcherMt(&config);
+#else
+  throw std::runtime_error("multithreading requires Bullet 2.88 or later");
+#endif
+}
+static btConstraintSolver * make_solver(unsigned threads)
+{
+  if(threads <= 1) return new btSequentialImpulseConstraintSolver;
+#ifdef TDSE_BULLET_MT
+  return new btSequentialImpulseConstraintSolverMt;
+#else
+  throw std::runtime_error("multithreading requires Bullet 2.88 or later");
+#endif
+}
+
+#include "grid_broadphase.h"
+#include "trace.h"
+#include "allocation.h"
+#include "projectile.h"
+static btBroadphaseInterface * make_broadphase(float grid_cell_size)
+{
+  if(grid_cell_size > 0.0f) return new grid_broadphase(grid_cell_size);
+  return new btDbvtBroadphase;
+}
+
+btDefaultCollisionConstructionInfo bullet_components::construction_info
+(const world_options & options)
+{
+  btDefaultCollisionConstructionInfo info;
+  info.m_defaultMaxPersistentManifoldPoolSize = options.contact_pool_size;
+  info.m_defaultMaxCollisionAlgorithmPoolSize = options.contact_pool_size;
+  return info;
+}
+bullet_components::bullet_components(const world_options & options)
+  : collision_config( construction_info(options) ),
+  dispatcher( make_dispatcher(collision_config, options.threads) ),
+  broadphase( make_broadphase(options.grid_cell_size) ),
+  solver( make_solver(options.threads) ),
+#ifdef TDSE_BULLET_MT
+  solver_pool( new btConstraintSolverPoolMt(options.threads > 1 ?
+                                            options.threads : 1) ),
+#endif
   convexAlgo2d(&simplex, &pdsolver)
 {
-  dispatcher.registerCollisionCreateFunc(CONVEX_2D_SHAPE_PROXYTYPE,
+  dispatcher->registerCollisionCreateFunc(CONVEX_2D_SHAPE_PROXYTYPE,
     CONVEX_2D_SHAPE_PROXYTYPE, &convexAlgo2d);
 }
 
 
-bullet_world::bullet_world()
-  : btDiscreteDynamicsWorld(&dispatcher, &overlapping_pair_cache, &solver,
-                            &collision_config)
+bullet_world::bullet_world(const world_options & options)
+  : bullet_components(options),
+#ifdef TDSE_BULLET_MT
+  bullet_world_base(dispatcher.get(), broadphase.get(), solver_pool.get(),
+                    options.threads > 1 ? solver.get() : nullptr,
+                    &collision_config),
+#else
+  bullet_world_base(dispatcher.get(), broadphase.get(), solver.get(),
+                    &collision_config),
+#endif
+  deterministic(options.deterministic),
+  threaded(options.threads > 1),
+  substep_(options.substep),
+  max_substeps(options.max_substeps),
+  budget(options.budget),
+  accumulated(0.0f),
+  next_body_id(0),
+  projectiles_(new projectile_system),
+  dispatching(false),
+  in_parallel_phase(false)
 {
+  if(substep_.count() <= 0.0f)
+    throw std::invalid_argument("substep must be greater than zero");
+  if(max_substeps < 1)
+    throw std::invalid_argument("max_substeps must be at least 1");
+  if( deterministic && (options.threads > 1 || budget.count() != 0) )
+    throw std::invalid_argument(
+      "deterministic worlds need one thread and no budget"
+    );
+
+#ifdef TDSE_BULLET_MT
+  // btSimulationIslandManagerMt never fills the lists the serial island
+  // callback reads, so serial stages would solve no contacts with it. With
+  // these swapped back, a world with one thread is a btDiscreteDynamicsWorld
+  // in all but type.
+  if(!threaded)
+  {
+    m_islandManager->~btSimulationIslandManager();
+    btAlignedFree(m_islandManager);
+    void * memory = btAlignedAlloc(sizeof(btSimulationIslandManager), 16);
+    m_islandManager = new(memory) btSimulationIslandManager;
+    btDiscreteDynamicsWorld::setConstraintSolver( solver.get() );
+  }
+#endif
   setGravity(btVector3(0, 0, 0));
+
+  // Order matches the phase_id constants
+  add_phase("input");
+  add_phase("weapons");
+  add_phase("projectiles");
+  add_phase("ai");
+  add_callback(*projectiles_, projectiles_phase);
 }
+bullet_world::~bullet_world()
+{}
 
 const float_seconds bullet_world::fixed_substep(1.0f/60.0f);
+float_seconds bullet_world::substep() const
+{
+  return substep_;
+}
+#include <algorithm>
+static unsigned long long allocations_so_far()
+{
+  if( !allocation_counter::installed() ) return 0;
+  return allocation_counter::totals().total_allocations();
+}
 void bullet_world::step(float_seconds step_time)
 {
-  // Limit to 10 substeps
-  stepSimulation( step_time.count(), 10, fixed_substep.count() );
+  auto start = std::chrono::steady_clock::now();
+  unsigned long long allocated = allocations_so_far();
+
+  // Stands in for btDiscreteDynamicsWorld::stepSimulation, with a budget
+  accumulated += step_time;
+  int due = accumulated/substep_;
+  if(due == 0) return;
+  int allowed = std::min(due, max_substeps);
+  saveKinematicState(substep_.count()*allowed);
+
+  int done = 0;
+  bool overrun = false;
+  for(; done != allowed; ++done)
+  {
+    // Always make some progress, even when the budget is tiny
+    if( done != 0 && budget.count() != 0 &&
+        std::chrono::steady_clock::now() - start >= budget )
+    {
+      overrun = true;
+      break;
+    }
+    // Forces, gravity included, apply to their own substep only
+    applyGravity();
+    internalSingleStepSimulation( substep_.count() );
+    clearForces();
+  }
+
+  // Whatever wasn't simulated is dropped rather than carried, which would
+  // only make the next step slower still
+  accumulated -= substep_*float(due);
+  stats_.substeps += done;
+  stats_.last_step_allocations = allocations_so_far() - allocated;
+  stats_.allocations += stats_.last_step_allocations;
+  trace_recorder & tracer = trace_recorder::instance();
+  if( tracer.enabled() ) tracer.step_finished("step", start, tick());
+  if(done != due)
+  {
+    float_seconds dropped = substep_*float(due - done);
+    stats_.dropped += dropped;
+    if(overrun) ++stats_.overruns;
+    overloaded(dropped, overrun);
+  }
+}
+void bullet_world::step_ticks(unsigned ticks)
+{
+  if(ticks == 0) return;
+  trace_recorder & tracer = trace_recorder::instance();
+  trace_recorder::clock::time_point start;
+  if( tracer.enabled() ) start = trace_recorder::clock::now();
+  unsigned long long allocated = allocations_so_far();
+  saveKinematicState(substep_.count()*ticks);
+  for(unsigned i = 0; i != ticks; ++i)
+  {
+    applyGravity();
+    internalSingleStepSimulation( substep_.count() );
+    clearForces();
+  }
+  stats_.substeps += ticks;
+  stats_.last_step_allocations = allocations_so_far() - allocated;
+  stats_.allocations += stats_.last_step_allocations;
+  if( tracer.enabled() ) tracer.step_finished("step", start, tick());
+}
+std::uint64_t bullet_world::tick() const
+{
+  return stats_.substeps;
+}
+#include <cstring>
+// FNV-1a over the raw bytes, so identical bits hash identically
+static void hash_bytes(std::uint64_t & hash, const void * data,
+                       std::size_t size)
+{
+  const unsigned char * bytes = static_cast<const unsigned char *>(data);
+  for(std::size_t i = 0; i != size; ++i)
+  {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+}
+static void hash_float(std::uint64_t & hash, float value)
+{
+  std::uint32_t bits;
+  std::memcpy( &bits, &value, sizeof(bits) );
+  hash_bytes( hash, &bits, sizeof(bits) );
+}
+std::uint64_t bullet_world::state_hash() const
+{
+  std::uint64_t hash = 14695981039346656037ull;
+  std::uint64_t ticks = tick();
+  hash_bytes( hash, &ticks, sizeof(ticks) );
+
+  // Collision objects stay in the order they were added and removed
+  for(int i = 0; i != m_collisionObjects.size(); ++i)
+  {
+    // All btCollisionObect instances are assumed to be body instances
+    const body & b = *static_cast<const body *>(m_collisionObjects[i]);
+    hash_bytes( hash, &b.id_, sizeof(b.id_) );
+
+    // In the plane, a transform is its origin and first basis column
+    const btTransform & trans = b.btRigidBody::getWorldTransform();
+    hash_float( hash, trans.getOrigin().getX() );
+    hash_float( hash, trans.getOrigin().getY() );
+    hash_float( hash, trans.getBasis()[0][0] );
+    hash_float( hash, trans.getBasis()[1][0] );
+    hash_float( hash, b.getLinearVelocity().getX() );
+    hash_float( hash, b.getLinearVelocity().getY() );
+    hash_float( hash, b.getAngularVelocity().getZ() );
+  }
+  return hash;
+}
+// Bullet's vectors and transforms have user-provided copy constructors, so
+// snapshots hold them as plain scalars
+static void write_vector(world_snapshot & snapshot, const btVector3 & v)
+{
+  snapshot.write( v.getX() );
+  snapshot.write( v.getY() );
+  snapshot.write( v.getZ() );
+}
+static void read_vector(world_snapshot & snapshot, btVector3 & v)
+{
+  btScalar x, y, z;
+  snapshot.read(x);
+  snapshot.read(y);
+  snapshot.read(z);
+  v.setValue(x, y, z);
+}
+static void write_transform(world_snapshot & snapshot, const btTransform & t)
+{
+  write_vector( snapshot, t.getOrigin() );
+  for(int row = 0; row != 3; ++row)
+    write_vector( snapshot, t.getBasis()[row] );
+}
+static void read_transform(world_snapshot & snapshot, btTransform & t)
+{
+  read_vector( snapshot, t.getOrigin() );
+  for(int row = 0; row != 3; ++row)
+    read_vector( snapshot, t.getBasis()[row] );
 }
+void bullet_world::save(world_snapshot & snapshot)
+{
+  check_serial("save");
+  if(deterministic)
+  {
+    // Drop the cached state restore can't bring back, so both runs continue
+    // from the same place
+    updateAabbs();
+    rebuild_broadphase();
+  }
+  snapshot.clear();
+  snapshot.write(stats_.substeps);
+  snapshot.write(accumulated);
+
+  int objects = m_collisionObjects.size();
+  snapshot.write(objects);
+  for(int i = 0; i != objects; ++i)
+  {
+    // All btCollisionObect instances are assumed to be body instances
+    const body & b = *static_cast<const body *>(m_collisionObjects[i]);
+    snapshot.write(b.id_);
+    write_transform( snapshot, b.btRigidBody::getWorldTransform() );
+    write_transform( snapshot, b.getInterpolationWorldTransform() );
+    write_vector( snapshot, b.getLinearVelocity() );
+    write_vector( snapshot, b.getAngularVelocity() );
+    write_vector( snapshot, b.getInterpolationLinearVelocity() );
+    write_vector( snapshot, b.getInterpolationAngularVelocity() );
+    snapshot.write( b.getActivationState() );
+    snapshot.write( b.getDeactivationTime() );
+    write_transform(snapshot, b.previous);
+    write_transform(snapshot, b.transform);
+    if(b.snapshot_handler_) b.snapshot_handler_->save(snapshot);
+  }
+
+  // Only touching pairs, since end events may refer to removed bodies.
+  // Bodies are stored by their place in the world, which restore checks.
+  std::size_t touching = 0;
+  while( touching != contacts_.size() &&
+         contacts_[touching].state != contact_event::end )
+    ++touching;
+  snapshot.write(touching);
+  for(auto i = contacts_.begin(); i != contacts_.begin() + touching; ++i)
+  {
+    snapshot.write( i->body0->getWorldArrayIndex() );
+    snapshot.write( i->body1->getWorldArrayIndex() );
+    snapshot.write(i->state);
+    snapshot.write(i->point);
+    snapshot.write(i->normal);
+    snapshot.write(i->impulse);
+  }
+
+  projectiles_->save(snapshot);
+}
+void bullet_world::restore(world_snapshot & snapshot)
+{
+  check_serial("restore");
+  snapshot.rewind();
+  snapshot.read(stats_.substeps);
+  snapshot.read(accumulated);
+
+  int objects;
+  snapshot.read(objects);
+  if( objects != m_collisionObjects.size() )
+    throw std::runtime_error("bodies were added or removed since snapshot");
+  for(int i = 0; i != objects; ++i)
+  {
+    body & b = *static_cast<body *>(m_collisionObjects[i]);
+    std::uint32_t id;
+    snapshot.read(id);
+    if(id != b.id_)
+      throw std::runtime_error("bodies were added or removed since snapshot");
+
+    btTransform trans;
+    btVector3 vec;
+    int activation;
+    btScalar deactivation;
+    // Also refreshes the world inertia tensor for the restored orientation
+    read_transform(snapshot, trans);
+    b.setCenterOfMassTransform(trans);
+    read_transform(snapshot, trans);
+    b.setInterpolationWorldTransform(trans);
+    read_vector(snapshot, vec);
+    b.setLinearVelocity(vec);
+    read_vector(snapshot, vec);
+    b.setAngularVelocity(vec);
+    read_vector(snapshot, vec);
+    b.setInterpolationLinearVelocity(vec);
+    read_vector(snapshot, vec);
+    b.setInterpolationAngularVelocity(vec);
+    snapshot.read(activation);
+    b.forceActivationState(activation);
+    snapshot.read(deactivation);
+    b.setDeactivationTime(deactivation);
+    read_transform(snapshot, b.previous);
+    read_transform(snapshot, b.transform);
+    if(b.snapshot_handler_) b.snapshot_handler_->restore(snapshot);
+  }
+
+  // Capacity is kept from earlier substeps, so this doesn't allocate
+  std::size_t contacts;
+  snapshot.read(contacts);
+  contacts_.clear();
+  for(std::size_t i = 0; i != contacts; ++i)
+  {
+    int index0, index1;
+    contact_event::state_type state;
+    glm::vec2 point, normal;
+    float impulse;
+    snapshot.read(index0);
+    snapshot.read(index1);
+    snapshot.read(state);
+    snapshot.read(point);
+    snapshot.read(normal);
+    snapshot.read(impulse);
+    contacts_.emplace_back( *static_cast<body *>(m_collisionObjects[index0]),
+                            *static_cast<body *>(m_collisionObjects[index1]),
+                            point, normal, impulse );
+    contacts_.back().state = state;
+  }
+
+  projectiles_->restore(snapshot);
+
+  // The live manifolds belong to the state being replaced
+  updateAabbs();
+  if(deterministic) rebuild_broadphase();
+  else flush_manifolds();
+}
+void bullet_world::flush_manifolds()
+{
+  // Frees each pair's algorithm and manifold but keeps the pair itself
+  btOverlappingPairCache & pairs =
+    *( getBroadphase()->getOverlappingPairCache() );
+  btBroadphasePairArray & array = pairs.getOverlappingPairArray();
+  for(int i = 0; i != array.size(); ++i)
+    pairs.cleanOverlappingPair( array[i], getDispatcher() );
+}
+void bullet_world::rebuild_broadphase()
+{
+  // Pair order, and so solving order, depends on every earlier step.
+  // Destroying every proxy frees each pair's manifold and resets the
+  // broadphase, and recreating them in world order finds the same pairs in
+  // the same order whatever came before.
+  btBroadphaseInterface & broadphase = *getBroadphase();
+  btOverlappingPairCache & pairs = *( broadphase.getOverlappingPairCache() );
+  proxy_filters.clear();
+  for(int i = 0; i != m_collisionObjects.size(); ++i)
+  {
+    btBroadphaseProxy * proxy = m_collisionObjects[i]->getBroadphaseHandle();
+    proxy_filters.emplace_back( proxy->m_collisionFilterGroup,
+                                proxy->m_collisionFilterMask );
+    pairs.cleanProxyFromPairs( proxy, getDispatcher() );
+    broadphase.destroyProxy( proxy, getDispatcher() );
+    m_collisionObjects[i]->setBroadphaseHandle(nullptr);
+  }
+  broadphase.resetPool( getDispatcher() );
+  for(int i = 0; i != m_collisionObjects.size(); ++i)
+  {
+    btCollisionObject & object = *m_collisionObjects[i];
+    btVector3 aabb_min, aabb_max;
+    object.getCollisionShape()->getAabb( object.getWorldTransform(),
+                                         aabb_min, aabb_max );
+    object.setBroadphaseHandle( broadphase.createProxy(
+      aabb_min, aabb_max, object.getCollisionShape()->getShapeType(),
+      &object, proxy_filters[i].first, proxy_filters[i].second,
+      getDispatcher()
+    ) );
+    // Adds the margins updateAabbs would
+    updateSingleAabb(&object);
+  }
+}
+void bullet_world::overloaded(float_seconds dropped, bool overrun)
+{}
+const bullet_world::step_stats & bullet_world::stats() const
+{
+  return stats_;
+}
+bullet_world::step_stats::step_stats()
+: substeps(0),
+  dropped(0.0f),
+  overruns(0),
+  allocations(0),
+  last_step_allocations(0)
+{}
+
+bullet_world::substep_timings::substep_timings()
+: substeps(0),
+  total(0),
+  slowest(0),
+  broadphase(0),
+  narrowphase(0),
+  solver(0),
+  integration(0),
+  contacts(0),
+  pairs(0),
+  manifolds(0),
+  contact_events(0)
+{}
+#ifdef TDSE_STATS
+const bool bullet_world::timings_enabled = true;
+#else
+const bool bullet_world::timings_enabled = false;
+#endif
+const bullet_world::substep_timings & bullet_world::timings() const
+{
+  return timings_;
+}
+void bullet_world::reset_timings()
+{
+  substep_timings cleared;
+  cleared.phases.assign( phases.size(), substep_timings::duration(0) );
+  timings_ = cleared;
+}
+
+// Adds the time until it's destroyed to a total, in builds with TDSE_STATS.
+// Otherwise it's empty and optimizes away.
+class stopwatch
+{
+public:
+  typedef std::chrono::steady_clock clock;
+#ifdef TDSE_STATS
+  explicit stopwatch(clock::duration & total_)
+  : total(total_), start( clock::now() )
+  {}
+  ~stopwatch()
+  {
+    total += clock::now() - start;
+  }
+
+private:
+  clock::duration & total;
+  clock::time_point start;
+#else
+  explicit stopwatch(clock::duration &)
+  {}
+#endif
+};
+
 void bullet_world::presubstep(float_seconds substep_time)
 {
+#ifdef TDSE_STATS
+  auto start = stopwatch::clock::now();
+#endif
+  trace_scope substep_trace("substep");
   // Trigger all presubstep callbacks
-  for(auto i = presubsteps.begin(); i != presubsteps.end(); ++i)
-    (*i)->presubstep( *this, substep_time );
+  for(phase_id i = 0; i != phases.size(); ++i)
+  {
+    stopwatch timer( timings_.phases[i] );
+    run_phase(phases[i], substep_time);
+  }
 
   // Step physics world
-  btDiscreteDynamicsWorld::internalSingleStepSimulation( substep_time.count() );
+  {
+    trace_scope trace("bullet");
+    btDiscreteDynamicsWorld::internalSingleStepSimulation(
+      substep_time.count()
+    );
+  }
+
+  // Record the result in every motion state, so renderers can blend the
+  // last two substeps. Sleeping bodies are included so they settle.
+  for(int i = 0; i != m_nonStaticRigidBodies.size(); ++i)
+  {
+    btRigidBody & rigid = *m_nonStaticRigidBodies[i];
+    if( btMotionState * state = rigid.getMotionState() )
+      state->setWorldTransform( rigid.getWorldTransform() );
+  }
+
+  // Collect contact events and trigger collision callbacks in bulk
+  {
+    stopwatch timer(timings_.contacts);
+    trace_scope trace("contacts");
+    gather_contacts();
+    // Bodies removed by callbacks stay in contacts_ until all have run, but
+    // their pairs aren't dispatched any more
+    dispatching = true;
+    try
+    {
+      for(auto i = contacts_.begin(); i != contacts_.end(); ++i)
+      {
+        if(i->state == contact_event::end) break;
+        // It's safe to modify bodies between substeps
+        if( removed(i->body0) || removed(i->body1) ) continue;
+        if( needs_collision * ptr = i->body0->collision_handler_ )
+          ptr->collision(*i->body1);
+        if( removed(i->body0) || removed(i->body1) ) continue;
+        if( needs_collision * ptr = i->body1->collision_handler_ )
+          ptr->collision(*i->body0);
+      }
+    }
+    catch(...)
+    {
+      dispatching = false;
+      end_removed_contacts();
+      throw;
+    }
+    dispatching = false;
+    end_removed_contacts();
+  }
+
+#ifdef TDSE_STATS
+  timings_.contact_events += contacts_.size();
+  ++timings_.substeps;
+  auto elapsed = stopwatch::clock::now() - start;
+  timings_.total += elapsed;
+  if(elapsed > timings_.slowest) timings_.slowest = elapsed;
+#endif
+}
+
+// Order by body id rather than address, so every run agrees
+static bool pair_less(const contact_event & a, const contact_event & b)
+{
+  if(a.body0 != b.body0) return a.body0->id() < b.body0->id();
+  return a.body1->id() < b.body1->id();
+}
+static bool same_pair(const contact_event & a, const contact_event & b)
+{
+  return a.body0 == b.body0 && a.body1 == b.body1;
+}
+void bullet_world::gather_contacts()
+{
+  // Both buffers keep their capacity, so steady state doesn't allocate
+  contacts_.swap(previous_contacts_);
+  contacts_.clear();
 
-  // Trigger all collision callbacks
   btDispatcher & dispatcher = *( getDispatcher() );
   int manifolds = dispatcher.getNumManifolds();
   for(int i = 0; i != manifolds; ++i)
@@ -88,52 +684,378 @@ void bullet_world::presubstep(float_seconds substep_time)
     int contacts = manifold.getNumContacts();
     for(int contact = 0; contact != contacts; ++contact)
     {
-      if(manifold.getContactPoint(contact).getDistance() <= 0.0)
+      const btManifoldPoint & point = manifold.getContactPoint(contact);
+      if(point.getDistance() <= 0.0)
       {
         // All btCollisionObect instances are assumed to be body instances
-        // It's safe to modify bodies between substeps
         body * body0 = static_cast<body *>
           ( const_cast<btCollisionObject *>(manifold.getBody0()) );
         body * body1 = static_cast<body *>
           ( const_cast<btCollisionObject *>(manifold.getBody1()) );
 
-        needs_collision * ptr;
-        if( (ptr = dynamic_cast<needs_collision *>(body0)) )
-          ptr->collision(*body1);
-        if( (ptr = dynamic_cast<needs_collision *>(body1)) )
-          ptr->collision(*body0);
-
+        const btVector3 & p = point.getPositionWorldOnB();
+        const btVector3 & n = point.m_normalWorldOnB;
+        glm::vec2 normal( n.getX(), n.getY() );
+        // Order each pair so duplicates from other manifolds sort together
+        if( body1->id_ < body0->id_ )
+        {
+          std::swap(body0, body1);
+          normal = -normal;
+        }
+        contacts_.emplace_back( *body0, *body1, glm::vec2( p.getX(), p.getY() ),
+                                normal, point.getAppliedImpulse() );
         break;
       }
     }
   }
+
+  // Merge pairs that touch through several manifolds, summing impulses
+  std::sort(contacts_.begin(), contacts_.end(), pair_less);
+  if( !contacts_.empty() )
+  {
+    auto last = contacts_.begin();
+    for(auto i = last + 1; i != contacts_.end(); ++i)
+    {
+      if( same_pair(*last, *i) ) last->impulse += i->impulse;
+      else *(++last) = *i;
+    }
+    contacts_.erase(last + 1, contacts_.end());
+  }
+
+  // Walk both sorted buffers to find pairs that began, persisted or ended.
+  // Ended pairs are appended, so make room to keep references valid.
+  std::size_t touching = contacts_.size();
+  contacts_.reserve( touching + previous_contacts_.size() );
+  auto previous = previous_contacts_.cbegin();
+  for(std::size_t i = 0; i != touching; ++i)
+  {
+    contact_event & current = contacts_[i];
+    while( previous != previous_contacts_.cend() &&
+           previous->state != contact_event::end &&
+           pair_less(*previous, current) )
+    {
+      contacts_.push_back(*previous);
+      contacts_.back().state = contact_event::end;
+      ++previous;
+    }
+    if( previous != previous_contacts_.cend() &&
+        previous->state != contact_event::end &&
+        same_pair(*previous, current) )
+    {
+      current.state = contact_event::persist;
+      ++previous;
+    }
+  }
+  for(; previous != previous_contacts_.cend() &&
+        previous->state != contact_event::end; ++previous)
+  {
+    contacts_.push_back(*previous);
+    contacts_.back().state = contact_event::end;
+  }
+}
+projectile_system & bullet_world::projectiles()
+{
+  check_serial("projectiles");
+  return *projectiles_;
+}
+const projectile_system & bullet_world::projectiles() const
+{
+  return *projectiles_;
+}
+const std::vector<contact_event> & bullet_world::contacts() const
+{
+  return contacts_;
+}
+
+bullet_world::phase::phase(const std::string & name_, bool parallel_)
+: name(name_), parallel(parallel_), enabled(true),
+  trace_name( trace_recorder::instance().intern("phase " + name) )
+{}
+
+#ifdef TDSE_BULLET_MT
+class parallel_presubstep : public btIParallelForBody
+{
+public:
+  parallel_presubstep(needs_presubstep * const * callbacks_,
+                      bullet_world & world_, float_seconds substep_time_)
+  : callbacks(callbacks_), world(world_), substep_time(substep_time_)
+  {}
+  void forLoop(int begin, int end) const override
+  {
+    for(int i = begin; i != end; ++i)
+      callbacks[i]->presubstep(world, substep_time);
+  }
+
+private:
+  needs_presubstep * const * callbacks;
+  bullet_world & world;
+  float_seconds substep_time;
+};
+// Callbacks per task, enough that scheduling doesn't outweigh them
+static const int parallel_grain_size = 8;
+#endif
+// Sets a flag for as long as it exists
+class flag_scope
+{
+public:
+  flag_scope(bool & flag_, bool value)
+  : flag(flag_)
+  {
+    flag = value;
+  }
+  ~flag_scope()
+  {
+    flag = false;
+  }
+
+private:
+  bool & flag;
+};
+void bullet_world::check_serial(const char * function) const
+{
+  if(in_parallel_phase)
+    throw std::logic_error( std::string(function) +
+                            " called from a parallel phase" );
+}
+void bullet_world::run_phase(const phase & p, float_seconds substep_time)
+{
+  if(!p.enabled) return;
+  trace_scope phase_trace( p.trace_name, p.callbacks.size() );
+  // Even when the phase runs serially, so mistakes show up in every build
+  flag_scope parallel_scope(in_parallel_phase, p.parallel);
+#ifdef TDSE_BULLET_MT
+  if(p.parallel && !deterministic && p.callbacks.size() > 1)
+  {
+    parallel_presubstep loop(p.callbacks.data(), *this, substep_time);
+    btParallelFor(0, p.callbacks.size(), parallel_grain_size, loop);
+    return;
+  }
+#endif
+  trace_recorder & tracer = trace_recorder::instance();
+  if( !tracer.enabled() )
+  {
+    for(auto i = p.callbacks.begin(); i != p.callbacks.end(); ++i)
+      (*i)->presubstep(*this, substep_time);
+    return;
+  }
+  // One span per run of callbacks of the same class, which shows where the
+  // time goes without a span per entity
+  for(auto i = p.callbacks.begin(); i != p.callbacks.end(); )
+  {
+    trace_event event;
+    event.name = nullptr;
+    event.type = &typeid(**i);
+    event.begin = trace_recorder::clock::now();
+    auto run = i;
+    do
+      (*i++)->presubstep(*this, substep_time);
+    while( i != p.callbacks.end() && typeid(**i) == *event.type );
+    event.count = i - run;
+    event.end = trace_recorder::clock::now();
+    tracer.record(event);
+  }
+}
+
+const bullet_world::phase_id bullet_world::input_phase;
+const bullet_world::phase_id bullet_world::weapons_phase;
+const bullet_world::phase_id bullet_world::projectiles_phase;
+const bullet_world::phase_id bullet_world::ai_phase;
+bullet_world::phase_id bullet_world::add_phase(const std::string & name,
+                                               bool parallel)
+{
+  check_serial("add_phase");
+  phases.emplace_back(name, parallel);
+  timings_.phases.emplace_back(0);
+  return phases.size() - 1;
+}
+bullet_world::phase_id bullet_world::find_phase(const std::string & name) const
+{
+  for(phase_id i = 0; i != phases.size(); ++i)
+    if(phases[i].name == name) return i;
+  throw std::out_of_range("no presubstep phase named " + name);
+}
+const std::string & bullet_world::phase_name(phase_id phase) const
+{
+  return phases.at(phase).name;
+}
+bool bullet_world::phase_parallel(phase_id phase) const
+{
+  return phases.at(phase).parallel;
+}
+void bullet_world::phase_parallel(phase_id phase, bool parallel)
+{
+  check_serial("phase_parallel");
+  phases.at(phase).parallel = parallel;
+}
+bool bullet_world::phase_enabled(phase_id phase) const
+{
+  return phases.at(phase).enabled;
+}
+void bullet_world::phase_enabled(phase_id phase, bool enabled)
+{
+  check_serial("phase_enabled");
+  phases.at(phase).enabled = enabled;
 }
 
-void bullet_world::add_callback(needs_presubstep & callback)
+void bullet_world::add_callback(needs_presubstep & callback, phase_id phase)
 {
-  presubsteps.insert(&callback);
+  check_serial("add_callback");
+  std::vector<needs_presubstep *> & callbacks = phases.at(phase).callbacks;
+  if( std::find(callbacks.begin(), callbacks.end(), &callback) ==
+      callbacks.end() )
+    callbacks.push_back(&callback);
 }
 void bullet_world::remove_callback(needs_presubstep & callback)
 {
-  presubsteps.erase(&callback);
+  check_serial("remove_callback");
+  // Erase rather than swap with the last element, to keep the order stable
+  for(auto i = phases.begin(); i != phases.end(); ++i)
+    i->callbacks.erase( std::remove(i->callbacks.begin(), i->callbacks.end(),
+                                    &callback),
+                        i->callbacks.end() );
 }
 void bullet_world::add_body(body & b)
 {
+  check_serial("add_body");
+  // Pay for RTTI once here instead of once per contact or hit
+  b.collision_handler_ = dynamic_cast<needs_collision *>(&b);
+  b.hit_handler_ = dynamic_cast<needs_hit *>(&b);
+  b.snapshot_handler_ = dynamic_cast<needs_snapshot *>(&b);
+  b.id_ = next_body_id++;
   addRigidBody(&b);
 }
 void bullet_world::remove_body(body & b)
 {
+  check_serial("remove_body");
   removeRigidBody(&b);
+  removed_bodies.push_back(&b);
+  // Callbacks index contacts_, so leave it alone until they're done
+  if(!dispatching) end_removed_contacts();
+}
+bool bullet_world::removed(const body * b) const
+{
+  return std::find(removed_bodies.begin(), removed_bodies.end(), b) !=
+         removed_bodies.end();
+}
+void bullet_world::end_removed_contacts()
+{
+  // Touching pairs with a removed body move behind the rest, where they
+  // join the end events
+  auto touching_end = std::find_if( contacts_.begin(), contacts_.end(),
+    [](const contact_event & e)
+    {
+      return e.state == contact_event::end;
+    }
+  );
+  auto ended = std::stable_partition( contacts_.begin(), touching_end,
+    [this](const contact_event & e)
+    {
+      return !removed(e.body0) && !removed(e.body1);
+    }
+  );
+  for(auto i = ended; i != touching_end; ++i)
+    i->state = contact_event::end;
+  removed_bodies.clear();
 }
 
 void bullet_world::internalSingleStepSimulation(btScalar timeStep)
 {
   presubstep( float_seconds(timeStep) );
 }
+void bullet_world::synchronizeMotionStates()
+{}
+void bullet_world::performDiscreteCollisionDetection()
+{
+#ifdef TDSE_STATS
+  auto start = stopwatch::clock::now();
+  auto broadphase_before = timings_.broadphase;
+#endif
+  btDiscreteDynamicsWorld::performDiscreteCollisionDetection();
+#ifdef TDSE_STATS
+  // The broadphase runs inside; the rest is the narrowphase
+  timings_.narrowphase += (stopwatch::clock::now() - start) -
+                          (timings_.broadphase - broadphase_before);
+  timings_.pairs +=
+    getBroadphase()->getOverlappingPairCache()->getNumOverlappingPairs();
+  timings_.manifolds += getDispatcher()->getNumManifolds();
+#endif
+}
+void bullet_world::updateAabbs()
+{
+  stopwatch timer(timings_.broadphase);
+  btDiscreteDynamicsWorld::updateAabbs();
+}
+void bullet_world::computeOverlappingPairs()
+{
+  stopwatch timer(timings_.broadphase);
+  btDiscreteDynamicsWorld::computeOverlappingPairs();
+}
+// btDiscreteDynamicsWorldMt overrides these four with btParallelFor loops,
+// which would put worlds with one thread on the shared scheduler. They get
+// btDiscreteDynamicsWorld's serial versions instead.
+void bullet_world::predictUnconstraintMotion(btScalar timeStep)
+{
+#ifdef TDSE_BULLET_MT
+  if(threaded)
+  {
+    bullet_world_base::predictUnconstraintMotion(timeStep);
+    return;
+  }
+#endif
+  btDiscreteDynamicsWorld::predictUnconstraintMotion(timeStep);
+}
+void bullet_world::createPredictiveContacts(btScalar timeStep)
+{
+#ifdef TDSE_BULLET_MT
+  if(threaded)
+  {
+    bullet_world_base::createPredictiveContacts(timeStep);
+    return;
+  }
+#endif
+  btDiscreteDynamicsWorld::createPredictiveContacts(timeStep);
+}
+void bullet_world::solveConstraints(btContactSolverInfo & solver_info)
+{
+  stopwatch timer(timings_.solver);
+#ifdef TDSE_BULLET_MT
+  if(threaded)
+  {
+    bullet_world_base::solveConstraints(solver_info);
+    return;
+  }
+#endif
+  btDiscreteDynamicsWorld::solveConstraints(solver_info);
+}
+void bullet_world::integrateTransforms(btScalar timeStep)
+{
+  stopwatch timer(timings_.integration);
+#ifdef TDSE_BULLET_MT
+  if(threaded)
+  {
+    bullet_world_base::integrateTransforms(timeStep);
+    return;
+  }
+#endif
+  btDiscreteDynamicsWorld::integrateTransforms(timeStep);
+}
+float bullet_world::alpha() const
+{
+  return accumulated/substep_;
+}
+
+
+contact_event::contact_event(body & body0_, body & body1_,
+                             const glm::vec2 & point_,
+                             const glm::vec2 & normal_, float impulse_)
+: body0(&body0_), body1(&body1_), state(begin), point(point_),
+  normal(normal_), impulse(impulse_)
+{}
 
 
 motion_state::motion_state(const glm::mat3 & transform_)
-: transform( glm2d_to_bt(transform_) )
+: previous( glm2d_to_bt(transform_) ),
+  transform(previous)
 {}
 
 glm::mat3 motion_state::model() const
@@ -156,6 +1078,25 @@ glm::vec2 motion_state::position() const
   const btVector3 & pos = transform.getOrigin();
   return glm::vec2(pos.getX(), pos.getY());
 }
+glm::mat3 motion_state::interpolated_model(float alpha) const
+{
+  const btVector3 & pos0 = previous.getOrigin();
+  const btVector3 & pos1 = transform.getOrigin();
+  glm::vec2 pos = glm::mix( glm::vec2( pos0.getX(), pos0.getY() ),
+                            glm::vec2( pos1.getX(), pos1.getY() ), alpha );
+
+  // Turn the short way around
+  float angle0 = angle_from_mat2( bt_to_glm2d( previous.getBasis() ) );
+  float angle1 = angle_from_mat2( bt_to_glm2d( transform.getBasis() ) );
+  float angle = angle0 - rad_diff(angle0, angle1)*alpha;
+
+  return compose_transform( pos, mat2_from_angle(angle) );
+}
+
+void motion_state::reset(const btTransform & transform_)
+{
+  previous = transform = transform_;
+}
 
 void motion_state::getWorldTransform(btTransform & world_trans) const
 {
@@ -163,6 +1104,7 @@ void motion_state::getWorldTransform(btTransform & world_trans) const
 }
 void motion_state::setWorldTransform(const btTransform & world_trans)
 {
+  previous = transform;
   transform = world_trans;
 }
 
@@ -203,7 +1145,11 @@ body::body(float mass,
   btRigidBody( info(
     mass, *this, shape,
     calc_local_inertia(shape, mass)
-  ) )
+  ) ),
+  id_(0),
+  collision_handler_(nullptr),
+  hit_handler_(nullptr),
+  snapshot_handler_(nullptr)
 {
   // Restrict linear movement to the XY plane
   setLinearFactor(btVector3(1, 1, 0));
@@ -227,5 +1173,21 @@ glm::vec2 body::real_position() const
 
 void body::warp(const glm::mat3 & new_trans)
 {
-  btRigidBody::setWorldTransform( glm2d_to_bt(new_trans) );
+  btTransform bt_trans = glm2d_to_bt(new_trans);
+  btRigidBody::setWorldTransform(bt_trans);
+  // Don't draw the body sliding to where it was warped
+  motion_state::reset(bt_trans);
+}
+
+needs_collision * body::collision_handler() const
+{
+  return collision_handler_;
+}
+needs_hit * body::hit_handler() const
+{
+  return hit_handler_;
+}
+std::uint32_t body::id() const
+{
+  return id_;
 }
@@ -20,11 +20,18 @@ with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
 
 
 #include "glm.h"
+#include "snapshot.h"
 #include <btBulletDynamicsCommon.h>
 #include <BulletCollision/CollisionDispatch/btConvex2dConvex2dAlgorithm.h>
+#include <BulletCollision/CollisionShapes/btBox2dShape.h>
 #include <BulletCollision/CollisionShapes/btConvex2dShape.h>
 #include <BulletCollision/NarrowPhaseCollision/btMinkowskiPenetrationDepthSolver.h>
 #include <LinearMath/btGeometryUtil.h>
+// Bullet 2.88 added a multithreaded world, dispatcher and solver
+#if BT_BULLET_VERSION >= 288
+#define TDSE_BULLET_MT
+#include <BulletDynamics/Dynamics/btDiscreteDynamicsWorldMt.h>
+#endif
 
 
 template<class T> btConvexHullShape make_convex_hull(const T & vertices)
@@ -59,20 +66,65 @@ glm::mat3 bt_to_glm2d(const btTransform & bttrans);
 btTransform glm2d_to_bt(const glm::mat3 & glmtrans);
 
 
+#include <chrono>
+typedef std::chrono::duration< float, std::ratio<1> > float_seconds;
+class world_options
+{
+public:
+  world_options();
+
+  // Simulated time per substep
+  float_seconds substep;
+  // Substeps allowed per step before the rest of the time is dropped
+  int max_substeps;
+  // Wall-clock time a step may spend substepping before it drops the
+  // remaining substeps. Zero disables the budget.
+  std::chrono::steady_clock::duration budget;
+
+  // Worker threads for Bullet's step. Values above 1 run collision
+  // dispatch, island solving and integration on Bullet's task scheduler,
+  // which requires Bullet 2.88 or later built with BT_THREADSAFE. Bullet
+  // has one scheduler per process: the first world with threads above 1
+  // creates it for the life of the process, and later ones must ask for as
+  // many threads or their constructor throws std::invalid_argument.
+  unsigned threads;
+  // Positive values replace btDbvtBroadphase with a grid_broadphase of this
+  // cell size. Suits planar worlds of similarly sized bodies.
+  float grid_cell_size;
+  // Guarantee identical results from identical inputs, for lockstep play.
+  // Requires one thread and no budget; parallel phases run sequentially.
+  bool deterministic;
+  // Contact manifolds and collision algorithms preallocated for touching
+  // pairs. Pairs beyond it allocate on the heap as they start touching.
+  int contact_pool_size;
+};
+
+
+#include <memory>
 class bullet_world;
 class bullet_components
 {
 public:
-  bullet_components();
+  bullet_components(const world_options & options);
 private:
   friend class bullet_world;
   // collision configuration contains default setup for memory, collision setup. Advanced users can create their own configuration.
   btDefaultCollisionConfiguration collision_config;
-  btCollisionDispatcher dispatcher;
-  // btDbvtBroadphase is a good general purpose broadphase. You can also try out btAxis3Sweep.
-  btDbvtBroadphase overlapping_pair_cache;
-  // the default constraint solver. For parallel processing you can use a different solver (see Extras/BulletMultiThreaded)
-  btSequentialImpulseConstraintSolver solver;
+  static btDefaultCollisionConstructionInfo construction_info
+  (const world_options & options);
+  // btCollisionDispatcher, or btCollisionDispatcherMt when threads > 1
+  std::unique_ptr<btCollisionDispatcher> dispatcher;
+  // btDbvtBroadphase is a good general purpose broadphase; grid_broadphase
+  // is faster for crowds of similar bodies on a plane
+  std::unique_ptr<btBroadphaseInterface> broadphase;
+  // btSequentialImpulseConstraintSolver, or when threads > 1 its Mt variant
+  // for islands too big to share out between threads
+  std::unique_ptr<btConstraintSolver> solver;
+#ifdef TDSE_BULLET_MT
+  // A btSequentialImpulseConstraintSolver per thread, for islands solved in
+  // parallel. Worlds with one thread only hand it to the constructor.
+  std::unique_ptr<btConstraintSolverPoolMt> solver_pool;
+#endif
 
   // vaguely guessing from the Box2dDemo that this stuff is needed for collision between 2d shapes to work
   btVoronoiSimplexSolver simplex;
@@ -81,30 +133,227 @@ private:
 };
 
 
-#include <chrono>
-#include <set>
-typedef std::chrono::duration< float, std::ratio<1> > float_seconds;
+#include <cstdint>
+#include <string>
 class needs_presubstep;
 class body;
-class bullet_world : public bullet_components, public btDiscreteDynamicsWorld
+class contact_event
 {
 public:
-  bullet_world();
+  enum state_type {begin, persist, end};
+
+  contact_event(body & body0_, body & body1_, const glm::vec2 & point_,
+                const glm::vec2 & normal_, float impulse_);
+
+  body * body0;
+  body * body1;
+  state_type state;
+  // body0 has the lower id. First penetrating point, and the normal
+  // pointing from body1 to body0.
+  // End events repeat the values from the last substep the pair touched.
+  glm::vec2 point;
+  glm::vec2 normal;
+  float impulse;
+};
+
+
+#include <vector>
+#include <utility>
+class projectile_system;
+#ifdef TDSE_BULLET_MT
+// Worlds with one thread swap its island manager and solver for the plain
+// ones, and bypass its parallel stages for the serial ones
+typedef btDiscreteDynamicsWorldMt bullet_world_base;
+#else
+typedef btDiscreteDynamicsWorld bullet_world_base;
+#endif
+class bullet_world : public bullet_components, public bullet_world_base
+{
+public:
+  bullet_world( const world_options & options = world_options() );
+  ~bullet_world();
   bullet_world(const bullet_world &) = delete;
   void operator = (const bullet_world &) = delete;
 
+  // Default substep length
   static const float_seconds fixed_substep;
+  float_seconds substep() const;
   virtual void step(float_seconds step_time);
   virtual void presubstep(float_seconds substep_time);
-
-  void add_callback(needs_presubstep & callback);
+  // Fraction of a substep left unsimulated after the last step, in [0, 1).
+  // Pass to motion_state::interpolated_model to render between substeps.
+  float alpha() const;
+  // Run exactly this many substeps, bypassing the time accumulator.
+  // Lockstep peers call this with the same count to stay in sync.
+  void step_ticks(unsigned ticks);
+  // Substeps simulated since construction
+  std::uint64_t tick() const;
+  // Cheap digest of the tick and every body's id, transform and velocity.
+  // Lockstep peers compare hashes to detect desyncs.
+  std::uint64_t state_hash() const;
+
+  // Rollback support. Saving captures the tick, every body's motion and
+  // sleep state, the touching pairs in the contact buffer, projectiles in
+  // flight, and whatever bodies implementing needs_snapshot add. Restoring
+  // requires the same bodies in the same order and throws
+  // std::runtime_error otherwise. Restoring flushes Bullet's persistent
+  // contact manifolds, which snapshots don't hold, so contacts touching
+  // after a restore start without warm-starting. Saving leaves other worlds
+  // untouched, but deterministic ones also flush their manifolds and
+  // rebuild their broadphase when saving and restoring, so a run that
+  // restores a snapshot resimulates exactly like one that only saved it.
+  // The rebuild allocates a proxy per body.
+  void save(world_snapshot & snapshot);
+  void restore(world_snapshot & snapshot);
+
+  // Running totals since construction
+  class step_stats
+  {
+  public:
+    step_stats();
+
+    unsigned long long substeps;
+    // Simulation time discarded because a step hit max_substeps or budget
+    float_seconds dropped;
+    unsigned long overruns;
+    // Heap allocations anywhere in the process during steps, in total and
+    // in the latest step. Zero unless allocation_counter is installed.
+    unsigned long long allocations, last_step_allocations;
+  };
+  const step_stats & stats() const;
+
+  // Where substeps spend their time, totalled since construction or the
+  // last reset_timings(). Only gathered in builds configured with
+  // --enable-stats (see timings_enabled); otherwise everything stays zero
+  // and the timers compile to nothing.
+  class substep_timings
+  {
+  public:
+    typedef std::chrono::steady_clock::duration duration;
+    substep_timings();
+
+    unsigned long long substeps;
+    // Whole substeps, and the slowest one
+    duration total, slowest;
+    // Presubstep callbacks, indexed by phase_id
+    std::vector<duration> phases;
+    // Bullet's step: broadphase (AABB updates and pair finding),
+    // narrowphase (contact generation), constraint solving and integration.
+    // Whatever else Bullet does (islands, activation) is left out.
+    duration broadphase, narrowphase, solver, integration;
+    // Gathering contact events and running collision callbacks
+    duration contacts;
+    // Summed over substeps; divide by substeps for averages
+    unsigned long long pairs, manifolds, contact_events;
+  };
+  static const bool timings_enabled;
+  const substep_timings & timings() const;
+  void reset_timings();
+
+  // Presubstep callbacks run phase by phase, in the order phases were added.
+  // Within a phase they run in the order they were added, unless the phase is
+  // parallel, in which case they may run concurrently on Bullet's task
+  // scheduler and must not touch each other's state. Parallel callbacks may
+  // read the world, ray test it, and push their own bodies. What changes
+  // the world (adding or removing bodies and callbacks, changing phases,
+  // projectiles(), save and restore) throws std::logic_error during a
+  // parallel phase, even one run serially; on a worker thread, that ends
+  // the process.
+  typedef std::size_t phase_id;
+  static const phase_id input_phase = 0;
+  static const phase_id weapons_phase = 1;
+  static const phase_id projectiles_phase = 2;
+  static const phase_id ai_phase = 3;
+  phase_id add_phase(const std::string & name, bool parallel = false);
+  // Throws std::out_of_range if there is no such phase
+  phase_id find_phase(const std::string & name) const;
+  const std::string & phase_name(phase_id phase) const;
+  bool phase_parallel(phase_id phase) const;
+  void phase_parallel(phase_id phase, bool parallel);
+  // Disabled phases are skipped, e.g. to shed optional work when overloaded
+  bool phase_enabled(phase_id phase) const;
+  void phase_enabled(phase_id phase, bool enabled);
+
+  void add_callback(needs_presubstep & callback,
+                    phase_id phase = input_phase);
   void remove_callback(needs_presubstep & callback);
   void add_body(body & b);
+  // The body's touching pairs become end events. Collision callbacks may
+  // remove bodies; the change waits until every callback has run, and
+  // pairs with the removed body aren't dispatched after it.
   void remove_body(body & b);
 
+  // Every projectile in the world, stepped in projectiles_phase
+  projectile_system & projectiles();
+  const projectile_system & projectiles() const;
+
+  // One event per touching pair in the latest substep, sorted by body id,
+  // then an end event for each pair that stopped touching, including pairs
+  // with bodies removed since. Valid until the next substep. End events may
+  // point to removed bodies, which must not be used if they were destroyed.
+  const std::vector<contact_event> & contacts() const;
+
+protected:
+  // Called after a step that couldn't keep up, with the simulation time it
+  // dropped and whether it was cut short by the wall-clock budget. Does
+  // nothing by default.
+  virtual void overloaded(float_seconds dropped, bool overrun);
+
 private:
-  std::set<needs_presubstep *> presubsteps;
+  const bool deterministic;
+  // Runs Bullet's step on the task scheduler
+  const bool threaded;
+  const float_seconds substep_;
+  const int max_substeps;
+  const std::chrono::steady_clock::duration budget;
+  float_seconds accumulated;
+  step_stats stats_;
+  substep_timings timings_;
+  std::uint32_t next_body_id;
+
+  class phase
+  {
+  public:
+    phase(const std::string & name_, bool parallel_);
+
+    std::string name;
+    bool parallel;
+    bool enabled;
+    std::vector<needs_presubstep *> callbacks;
+    // "phase NAME", kept by trace_recorder
+    const char * trace_name;
+  };
+  std::vector<phase> phases;
+  std::unique_ptr<projectile_system> projectiles_;
+  void run_phase(const phase & p, float_seconds substep_time);
+
+  std::vector<contact_event> contacts_, previous_contacts_;
+  // Set while collision callbacks run, when removed bodies wait in
+  // removed_bodies for end_removed_contacts
+  bool dispatching;
+  std::vector<const body *> removed_bodies;
+  bool removed(const body * b) const;
+  // Set while a parallel phase runs. check_serial throws if it is.
+  bool in_parallel_phase;
+  void check_serial(const char * function) const;
+  void end_removed_contacts();
+  void gather_contacts();
+  void flush_manifolds();
+  // Collision filters of each body, kept while rebuild_broadphase runs
+  std::vector< std::pair<int, int> > proxy_filters;
+  void rebuild_broadphase();
   void internalSingleStepSimulation(btScalar timeStep) override;
+  // Bullet's own stages, overridden to time them
+  void performDiscreteCollisionDetection() override;
+  void updateAabbs() override;
+  void computeOverlappingPairs() override;
+  void solveConstraints(btContactSolverInfo & solver_info) override;
+  void integrateTransforms(btScalar timeStep) override;
+  // And to keep worlds with one thread off the task scheduler
+  void predictUnconstraintMotion(btScalar timeStep) override;
+  void createPredictiveContacts(btScalar timeStep) override;
+  // Motion states are updated after every substep instead
+  void synchronizeMotionStates() override;
 };
 
 
@@ -113,18 +362,28 @@ class motion_state : public btMotionState
 public:
   motion_state(const glm::mat3 & transform_);
 
+  // Transform after the latest substep
   glm::mat3 model() const;
   glm::mat2 orientation() const;
   glm::vec2 position() const;
+  // Blend of the two latest substeps; alpha 0 gives the earlier one
+  glm::mat3 interpolated_model(float alpha) const;
+
+protected:
+  // Forget the previous substep, as after a teleport
+  void reset(const btTransform & transform_);
 
 private:
-  btTransform transform;
+  friend class bullet_world;
+  btTransform previous, transform;
 
   void getWorldTransform(btTransform & worldTrans) const override;
   void setWorldTransform(const btTransform & worldTrans) override;
 };
 
 
+class needs_collision;
+class needs_hit;
 class body : public motion_state, public btRigidBody
 {
 private:
@@ -146,6 +405,22 @@ public:
   glm::vec2 real_position() const;
 
   void warp(const glm::mat3 & new_trans);
+
+  // Interfaces implemented by this body, resolved once by
+  // bullet_world::add_body so per-contact dispatch needs no RTTI.
+  // Null if not implemented or the body was never added to a world.
+  needs_collision * collision_handler() const;
+  needs_hit * hit_handler() const;
+  // Assigned by bullet_world::add_body in the order bodies are added, so it
+  // is the same on every lockstep peer
+  std::uint32_t id() const;
+
+private:
+  friend class bullet_world;
+  std::uint32_t id_;
+  needs_collision * collision_handler_;
+  needs_hit * hit_handler_;
+  needs_snapshot * snapshot_handler_;
 };
 
 
@@ -154,6 +429,13 @@ class needs_collision
 public:
   virtual void collision(body & b) = 0;
 };
+class hit_info;
+class needs_hit
+{
+protected:
+  virtual void hit(const hit_info & info) = 0;
+  friend class projectile;
+};
 class needs_presubstep
 {
 public:
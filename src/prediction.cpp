@@ -0,0 +1,70 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#include "prediction.h"
+
+
+input_command::input_command()
+: sequence(0),
+  predicted_position(0.0f, 0.0f)
+{}
+
+
+input_buffer::input_buffer()
+: first(0),
+  next(0)
+{}
+
+input_command & input_buffer::push(const player & controls)
+{
+  if(next - first == capacity) ++first;
+  input_command & command = commands[next % capacity];
+  command.sequence = next++;
+  command.controls = controls;
+  return command;
+}
+void input_buffer::acknowledge(std::uint32_t sequence)
+{
+  // Ignore acknowledgements from before the oldest command or after the
+  // newest, allowing for wraparound
+  if( static_cast<std::int32_t>(sequence - first) < 0 ||
+      static_cast<std::int32_t>(sequence - next) >= 0 )
+    return;
+  first = sequence + 1;
+}
+const input_command * input_buffer::find(std::uint32_t sequence) const
+{
+  if(sequence - first >= next - first) return nullptr;
+  return &commands[sequence % capacity];
+}
+
+std::size_t input_buffer::size() const
+{
+  return next - first;
+}
+input_command & input_buffer::operator [] (std::size_t i)
+{
+  return commands[(first + i) % capacity];
+}
+const input_command & input_buffer::operator [] (std::size_t i) const
+{
+  return commands[(first + i) % capacity];
+}
+std::uint32_t input_buffer::next_sequence() const
+{
+  return next;
+}
@@ -0,0 +1,167 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#ifndef PREDICTION_H_INCLUDED
+#define PREDICTION_H_INCLUDED
+
+
+#include "input.h"
+#include "protocol.h"
+#include <array>
+#include <cstdint>
+
+
+// Controls for one tick. Sequence numbers count ticks.
+class input_command
+{
+public:
+  input_command();
+
+  std::uint32_t sequence;
+  player controls;
+  // Where the client predicted its entity would be after this tick
+  glm::vec2 predicted_position;
+};
+
+// Commands the server hasn't acknowledged yet, oldest first
+class input_buffer
+{
+public:
+  // About two seconds at the default substep. When full, the oldest
+  // command is forgotten.
+  static constexpr std::size_t capacity = 128;
+
+  input_buffer();
+
+  input_command & push(const player & controls);
+  // Forget commands up to and including sequence
+  void acknowledge(std::uint32_t sequence);
+  // Null if sequence is unacknowledged or too old
+  const input_command * find(std::uint32_t sequence) const;
+
+  std::size_t size() const;
+  input_command & operator [] (std::size_t i);
+  const input_command & operator [] (std::size_t i) const;
+  std::uint32_t next_sequence() const;
+
+private:
+  std::array<input_command, capacity> commands;
+  // Oldest unacknowledged, and next to push
+  std::uint32_t first, next;
+};
+
+
+/*
+ * Client-side prediction for one locally controlled entity. The world should
+ * hold only the subject (and any static geometry it should bump into), so
+ * replaying costs the same however big the game. Add only the callbacks
+ * that move the subject, since replayed ticks run them again. Subject may
+ * be anything player::apply_input accepts.
+ */
+template<class Subject> class predictor
+{
+public:
+  predictor(bullet_world & world_, Subject & subject_);
+
+  // Apply controls for the next tick, step, and return the command to send
+  const input_command & step(const player & controls);
+  // Authoritative state after the server applied every command up to ack.
+  // Rewinds to it and replays the rest, unless the prediction at ack was
+  // already within tolerance.
+  void reconcile(const body_state & state, std::uint32_t ack);
+
+  // Offset from the corrected position to where the subject was drawn
+  // before the latest corrections. Add it when drawing to hide snapping;
+  // it shrinks by smoothing every tick.
+  const glm::vec2 & correction() const;
+
+  float tolerance;
+  float smoothing;
+  input_buffer inputs;
+  // Ticks replayed since construction
+  unsigned long long replayed;
+
+private:
+  bullet_world & world;
+  Subject & subject;
+  glm::vec2 correction_;
+};
+
+template<class Subject> predictor<Subject>::predictor(bullet_world & world_,
+                                                      Subject & subject_)
+: tolerance(0.01f),
+  smoothing(0.9f),
+  replayed(0),
+  world(world_),
+  subject(subject_),
+  correction_(0.0f, 0.0f)
+{}
+
+template<class Subject>
+const input_command & predictor<Subject>::step(const player & controls)
+{
+  input_command & command = inputs.push(controls);
+  command.controls.apply_input(subject);
+  world.step_ticks(1);
+  command.predicted_position = subject.real_position();
+  correction_ *= smoothing;
+  return command;
+}
+
+template<class Subject>
+void predictor<Subject>::reconcile(const body_state & state,
+                                   std::uint32_t ack)
+{
+  const input_command * predicted = inputs.find(ack);
+  bool agreed = predicted &&
+    glm::length(predicted->predicted_position - state.position) <=
+    tolerance;
+  inputs.acknowledge(ack);
+  if(agreed) return;
+
+  glm::vec2 drawn = subject.real_position() + correction_;
+  subject.warp( compose_transform( state.position,
+                                   mat2_from_angle(state.angle) ) );
+  subject.setInterpolationWorldTransform( subject.getWorldTransform() );
+  subject.setLinearVelocity( btVector3(state.velocity.x, state.velocity.y,
+                                       0.0f) );
+  subject.setAngularVelocity( btVector3(0.0f, 0.0f,
+                                        state.angular_velocity) );
+  subject.activate();
+
+  // Whatever the server hasn't seen yet happens again, and becomes the
+  // prediction later acknowledgements are checked against
+  for(std::size_t i = 0; i != inputs.size(); ++i)
+  {
+    input_command & command = inputs[i];
+    player controls = command.controls;
+    controls.apply_input(subject);
+    world.step_ticks(1);
+    command.predicted_position = subject.real_position();
+    ++replayed;
+  }
+  correction_ = drawn - subject.real_position();
+}
+
+template<class Subject>
+const glm::vec2 & predictor<Subject>::correction() const
+{
+  return correction_;
+}
+
+
+#endif  // PREDICTION_H_INCLUDED
@@ -16,23 +16,27 @@ You should have received a copy of the GNU Affero General Public License along
 with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
 */
 #include "projectile.h"
+#include "projectile_kernel.h"
+#include <limits>
+#include <stdexcept>
 
 
 projectile::properties::properties(float mass_, float range)
 : mass(mass_), range_squared(range*range)
 {}
 
-projectile::projectile(const properties & type_,
+projectile::projectile(const properties & type__,
                        const glm::vec2 & position_,
                        const glm::vec2 & velocity_)
-: type(type_), position__(position_), velocity__(velocity_), origin(position__)
+: type_(&type__), position__(position_), velocity__(velocity_),
+  origin__(position__)
 {}
 
 bool projectile::step(btCollisionWorld & world, float_seconds time)
 {
   // Return early if we're too far from the origin
-  auto diff = position__ - origin;
-  if(diff.x*diff.x + diff.y*diff.y > type.range_squared)
+  auto diff = position__ - origin__;
+  if(diff.x*diff.x + diff.y*diff.y > type_->range_squared)
     return true;
 
   // Calculate next position after step
@@ -44,29 +48,34 @@ bool projectile::step(btCollisionWorld & world, float_seconds time)
   // Raycast to find first collision
   btCollisionWorld::ClosestRayResultCallback result(bt_position, bt_target);
   world.rayTest(bt_position, bt_target, result);
-  if(result.m_collisionObject)
-  {
-    // Collision happened
-    body * victim = static_cast<body *>
-      // It's safe to modify btCollisionObjects in between substeps
-      ( const_cast<btCollisionObject *>(result.m_collisionObject) );
-
-    // If needed, notify with collision information
-    if( needs_hit * ptr = dynamic_cast<needs_hit *>(victim) )
-      ptr->hit( hit_info(
-        type,
-        velocity__,
-        glm::vec2( result.m_hitPointWorld.getX(),
-          result.m_hitPointWorld.getY() ),
-        glm::vec2( result.m_hitNormalWorld.getX(),
-          result.m_hitNormalWorld.getY() )
-      ) );
+  return hit(*type_, velocity__, result);
+}
+bool projectile::hit(const properties & type, const glm::vec2 & velocity,
+                     const btCollisionWorld::ClosestRayResultCallback & result)
+{
+  if(!result.m_collisionObject)
+    return false;
 
-    return true;
-  }
+  // Collision happened
+  body * victim = static_cast<body *>
+    // It's safe to modify btCollisionObjects in between substeps
+    ( const_cast<btCollisionObject *>(result.m_collisionObject) );
 
-  // No collision detected
-  return false;
+  // If needed, notify with collision information
+  if( needs_hit * ptr = victim->hit_handler() )
+    ptr->hit( hit_info(
+      type,
+      velocity,
+      glm::vec2( result.m_hitPointWorld.getX(),
+        result.m_hitPointWorld.getY() ),
+      glm::vec2( result.m_hitNormalWorld.getX(),
+        result.m_hitNormalWorld.getY() )
+    ) );
+  return true;
+}
+const projectile::properties & projectile::type() const
+{
+  return *type_;
 }
 const glm::vec2 & projectile::position() const
 {
@@ -76,6 +85,405 @@ const glm::vec2 & projectile::velocity() const
 {
   return velocity__;
 }
+const glm::vec2 & projectile::origin() const
+{
+  return origin__;
+}
+
+
+projectile_owner::projectile_owner()
+: system(nullptr)
+{}
+projectile_owner::projectile_owner(const projectile_owner &)
+: system(nullptr)
+{}
+projectile_owner & projectile_owner::operator = (const projectile_owner &)
+{
+  // Shots belong to this owner's identity, not its value
+  return *this;
+}
+projectile_owner::~projectile_owner()
+{
+  if(system) system->unbind(*this);
+}
+
+
+projectile_pool::handle::handle()
+: slot(-1), generation(0)
+{}
+bool projectile_pool::handle::operator == (const handle & other) const
+{
+  return slot == other.slot && generation == other.generation;
+}
+bool projectile_pool::handle::operator != (const handle & other) const
+{
+  return !(*this == other);
+}
+
+const std::size_t projectile_pool::npos = -1;
+const std::uint32_t projectile_pool::pending;
+
+projectile_pool::type_index projectile_pool::add_type
+(const projectile::properties & type)
+{
+  // Pools see few types, so a scan beats a map
+  for(std::size_t i = 0; i != table.size(); ++i)
+    if(table[i] == &type) return i;
+  if( table.size() > std::numeric_limits<type_index>::max() )
+    throw std::length_error("too many projectile types");
+  table.push_back(&type);
+  return table.size() - 1;
+}
+const projectile::properties & projectile_pool::type
+(type_index index) const
+{
+  return *table.at(index);
+}
+
+projectile_pool::handle projectile_pool::reserve()
+{
+  handle h;
+  if( free_slots.empty() )
+  {
+    h.slot = dense.size();
+    dense.push_back(pending);
+    generations.push_back(0);
+  }
+  else
+  {
+    h.slot = free_slots.back();
+    free_slots.pop_back();
+    dense[h.slot] = pending;
+  }
+  h.generation = generations[h.slot];
+  return h;
+}
+void projectile_pool::release(handle reserved)
+{
+  ++generations[reserved.slot];
+  free_slots.push_back(reserved.slot);
+}
+projectile_pool::handle projectile_pool::add(const projectile & shot,
+                                              const projectile_owner * owner)
+{
+  handle h = reserve();
+  add(shot, owner, h);
+  return h;
+}
+void projectile_pool::add(const projectile & shot,
+                          const projectile_owner * owner, handle reserved)
+{
+  type_index type = add_type( shot.type() );
+  dense[reserved.slot] = positions_.size();
+
+  positions_.push_back( shot.position() );
+  velocities_.push_back( shot.velocity() );
+  origins_.push_back( shot.origin() );
+  type_indices.push_back(type);
+  owners.push_back(owner);
+  slots.push_back(reserved.slot);
+}
+void projectile_pool::remove(std::size_t i)
+{
+  // Retire the slot, so its handles go stale
+  release( handle_of(i) );
+
+  // Move the last shot into the gap
+  std::size_t last = positions_.size() - 1;
+  if(i != last)
+  {
+    positions_[i] = positions_[last];
+    velocities_[i] = velocities_[last];
+    origins_[i] = origins_[last];
+    type_indices[i] = type_indices[last];
+    owners[i] = owners[last];
+    slots[i] = slots[last];
+    dense[ slots[i] ] = i;
+  }
+  positions_.pop_back();
+  velocities_.pop_back();
+  origins_.pop_back();
+  type_indices.pop_back();
+  owners.pop_back();
+  slots.pop_back();
+}
+void projectile_pool::clear()
+{
+  while( !empty() ) remove(size() - 1);
+}
+
+void projectile_pool::step(btCollisionWorld & world, float_seconds time)
+{
+  sweep(world, 0, &time, 0);
+}
+void projectile_pool::step(btCollisionWorld & world, std::size_t first,
+                           const std::vector<float_seconds> & times)
+{
+  if( times.size() != size() - first )
+    throw std::invalid_argument("need one time per shot");
+  sweep(world, first, times.data(), 1);
+}
+void projectile_pool::sweep(btCollisionWorld & world, std::size_t first,
+                            const float_seconds * times, std::size_t stride)
+{
+  // Gather each shot's range and time, so the kernel streams flat arrays
+  std::size_t count = size() - first;
+  range_squared.resize(count);
+  step_times.resize(count);
+  for(std::size_t i = 0; i != count; ++i, times += stride)
+  {
+    range_squared[i] = table[ type_indices[first + i] ]->range_squared;
+    step_times[i] = times->count();
+  }
+  targets.resize(count);
+  spent.resize(count);
+  projectile_kernel::step( count, positions_.data() + first,
+                           velocities_.data() + first,
+                           origins_.data() + first, range_squared.data(),
+                           step_times.data(), targets.data(), spent.data() );
+
+  // Move every shot still in range, casting a ray along each move
+  rays.clear();
+  swept.clear();
+  for(std::size_t i = 0; i != count; ++i)
+    if(!spent[i])
+    {
+      rays.add(positions_[first + i], targets[i]);
+      swept.push_back(first + i);
+      positions_[first + i] = targets[i];
+    }
+  rays.cast(world);
+
+  for(std::size_t r = 0; r != rays.size(); ++r)
+  {
+    std::size_t i = swept[r];
+    if( projectile::hit( *table[ type_indices[i] ], velocities_[i],
+                         rays.result(r) ) )
+      spent[i - first] = true;
+  }
+
+  // Backwards, so every shot moved into a gap has already been looked at
+  for(std::size_t i = size(); i-- != first; )
+    if(spent[i - first]) remove(i);
+}
+
+std::size_t projectile_pool::size() const
+{
+  return positions_.size();
+}
+bool projectile_pool::empty() const
+{
+  return positions_.empty();
+}
+std::size_t projectile_pool::find(handle h) const
+{
+  if( h.slot >= generations.size() || generations[h.slot] != h.generation
+      || dense[h.slot] == pending )
+    return npos;
+  return dense[h.slot];
+}
+projectile_pool::handle projectile_pool::handle_of(std::size_t i) const
+{
+  handle h;
+  h.slot = slots.at(i);
+  h.generation = generations[h.slot];
+  return h;
+}
+
+const glm::vec2 & projectile_pool::position(std::size_t i) const
+{
+  return positions_[i];
+}
+const glm::vec2 & projectile_pool::velocity(std::size_t i) const
+{
+  return velocities_[i];
+}
+const glm::vec2 & projectile_pool::origin(std::size_t i) const
+{
+  return origins_[i];
+}
+const projectile::properties & projectile_pool::type_of(std::size_t i) const
+{
+  return *table[ type_indices[i] ];
+}
+const projectile_owner * projectile_pool::owner(std::size_t i) const
+{
+  return owners[i];
+}
+const std::vector<glm::vec2> & projectile_pool::positions() const
+{
+  return positions_;
+}
+const std::vector<glm::vec2> & projectile_pool::velocities() const
+{
+  return velocities_;
+}
+
+// Vectors are resized in place, so restoring a pool that has held as many
+// shots before doesn't allocate
+template<class T> static void save_vector(const std::vector<T> & v,
+                                          world_snapshot & snapshot)
+{
+  snapshot.write( v.size() );
+  for(auto i = v.begin(); i != v.end(); ++i)
+    snapshot.write(*i);
+}
+template<class T> static void restore_vector(std::vector<T> & v,
+                                             world_snapshot & snapshot)
+{
+  std::size_t size;
+  snapshot.read(size);
+  v.resize(size);
+  for(auto i = v.begin(); i != v.end(); ++i)
+    snapshot.read(*i);
+}
+void projectile_pool::save(world_snapshot & snapshot) const
+{
+  save_vector(table, snapshot);
+  save_vector(positions_, snapshot);
+  save_vector(velocities_, snapshot);
+  save_vector(origins_, snapshot);
+  save_vector(type_indices, snapshot);
+  save_vector(owners, snapshot);
+  save_vector(slots, snapshot);
+  save_vector(dense, snapshot);
+  save_vector(generations, snapshot);
+  save_vector(free_slots, snapshot);
+}
+void projectile_pool::restore(world_snapshot & snapshot)
+{
+  restore_vector(table, snapshot);
+  restore_vector(positions_, snapshot);
+  restore_vector(velocities_, snapshot);
+  restore_vector(origins_, snapshot);
+  restore_vector(type_indices, snapshot);
+  restore_vector(owners, snapshot);
+  restore_vector(slots, snapshot);
+  restore_vector(dense, snapshot);
+  restore_vector(generations, snapshot);
+  restore_vector(free_slots, snapshot);
+}
+
+
+projectile_system::request::request(const projectile_owner * owner_,
+                                    const projectile & shot_,
+                                    float_seconds remainder_,
+                                    projectile_pool::handle slot_)
+: owner(owner_), shot(shot_), remainder(remainder_), slot(slot_)
+{}
+
+projectile_system::projectile_system()
+{}
+projectile_system::~projectile_system()
+{
+  // Owners outliving the world have nothing left to remove
+  for(auto i = bound.begin(); i != bound.end(); ++i)
+    (*i)->system = nullptr;
+}
+
+projectile_pool::handle projectile_system::spawn
+(const projectile_owner & owner, const projectile & shot,
+ float_seconds remainder)
+{
+  if(owner.system != this)
+  {
+    if(owner.system)
+      throw std::logic_error("projectile owner fired into another world");
+    owner.system = this;
+    bound.push_back(&owner);
+  }
+  projectile_pool::handle h = pool.reserve();
+  try
+  {
+    requests.emplace_back(&owner, shot, remainder, h);
+  }
+  catch(...)
+  {
+    pool.release(h);
+    throw;
+  }
+  return h;
+}
+#include <algorithm>
+void projectile_system::unbind(const projectile_owner & owner)
+{
+  remove_owner(owner);
+  auto found = std::find( bound.begin(), bound.end(), &owner );
+  *found = bound.back();
+  bound.pop_back();
+  owner.system = nullptr;
+}
+void projectile_system::remove_owner(const projectile_owner & owner)
+{
+  for(std::size_t i = 0; i < pool.size(); )
+    if(pool.owner(i) == &owner) pool.remove(i);
+    else ++i;
+  for(std::size_t i = 0; i < requests.size(); )
+    if(requests[i].owner == &owner)
+    {
+      pool.release(requests[i].slot);
+      requests[i] = requests.back();
+      requests.pop_back();
+    }
+    else ++i;
+}
+void projectile_system::clear()
+{
+  pool.clear();
+  for(auto i = requests.begin(); i != requests.end(); ++i)
+    pool.release(i->slot);
+  requests.clear();
+}
+
+const projectile_pool & projectile_system::shots() const
+{
+  return pool;
+}
+std::size_t projectile_system::size() const
+{
+  return pool.size();
+}
+
+void projectile_system::save(world_snapshot & snapshot) const
+{
+  pool.save(snapshot);
+  // Normally empty between steps, unless the phase was disabled
+  snapshot.write( requests.size() );
+  for(auto i = requests.begin(); i != requests.end(); ++i)
+    snapshot.write(*i);
+}
+void projectile_system::restore(world_snapshot & snapshot)
+{
+  pool.restore(snapshot);
+  std::size_t size;
+  snapshot.read(size);
+  // Every byte is overwritten, so the placeholder's values don't matter
+  static const projectile::properties none(0.0f, 0.0f);
+  const request placeholder(
+    nullptr, projectile( none, glm::vec2(0.0f), glm::vec2(0.0f) ),
+    float_seconds(0.0f), projectile_pool::handle()
+  );
+  requests.assign(size, placeholder);
+  for(auto i = requests.begin(); i != requests.end(); ++i)
+    snapshot.read(*i);
+}
+
+void projectile_system::presubstep(bullet_world & world,
+                                   float_seconds substep_time)
+{
+  // Shots already in flight get the whole substep
+  pool.step(world, substep_time);
+  // Then those fired during it, in the order they were fired
+  std::size_t first = pool.size();
+  remainders.clear();
+  for(auto i = requests.begin(); i != requests.end(); ++i)
+  {
+    pool.add(i->shot, i->owner, i->slot);
+    remainders.push_back(i->remainder);
+  }
+  requests.clear();
+  pool.step(world, first, remainders);
+}
 
 
 hit_info::hit_info(const projectile::properties & t, const glm::vec2 & v,
@@ -34,19 +34,199 @@ public:
     float range_squared;
   };
 
-  projectile(const properties & type_,
+  projectile(const properties & type__,
              const glm::vec2 & position_,
              const glm::vec2 & velocity_);
 
   // Returns true on collision, otherwise false
   bool step(btCollisionWorld & world, float_seconds time);
+  // Notify whatever a shot of this type and velocity ran into, if the ray
+  // hit anything. Returns true if it did.
+  static bool hit(const properties & type, const glm::vec2 & velocity,
+                  const btCollisionWorld::ClosestRayResultCallback & result);
+  const properties & type() const;
   const glm::vec2 & position() const;
   const glm::vec2 & velocity() const;
+  const glm::vec2 & origin() const;
 
-  const properties & type;
+private:
+  // A pointer rather than a reference, so projectiles are assignable
+  const properties * type_;
+  glm::vec2 position__, velocity__, origin__;
+};
+
+
+// Whatever fired a projectile, e.g. a shooter. Shots are tagged with it so
+// their owner can find them again. Its first shot binds it to that world's
+// projectile_system, and destroying it drops its shots from there.
+class projectile_system;
+class projectile_owner
+{
+public:
+  projectile_owner();
+  // Copies start unbound, with no shots of their own
+  projectile_owner(const projectile_owner & other);
+  projectile_owner & operator = (const projectile_owner & other);
+  ~projectile_owner();
+
+private:
+  friend class projectile_system;
+  mutable projectile_system * system;
+};
+
+
+#include "ray_batch.h"
+#include <cstdint>
+#include <vector>
+/*
+ * Projectiles in flight, stored as parallel arrays so stepping streams
+ * through memory. Each step casts all the shots' rays as one ray_batch and
+ * reports hits afterwards, in the order of the shots. Removing a shot moves
+ * the last one into its place, so indices change; a handle follows its shot
+ * until it's gone. Properties are kept by address in a table indexed by
+ * type_index, and must outlive the shots and any snapshot holding them.
+ * Owners are only compared. Hit handlers mustn't destroy bodies, since
+ * later hits from the same step may refer to them.
+ */
+class projectile_pool
+{
+public:
+  class handle
+  {
+  public:
+    // Refers to no shot
+    handle();
+    bool operator == (const handle & other) const;
+    bool operator != (const handle & other) const;
+
+    std::uint32_t slot, generation;
+  };
+  typedef std::uint16_t type_index;
+  static const std::size_t npos;
+
+  // Index of type in the table, adding it if new
+  type_index add_type(const projectile::properties & type);
+  const projectile::properties & type(type_index index) const;
+
+  handle add(const projectile & shot,
+             const projectile_owner * owner = nullptr);
+  // Take a slot now and fill it later with add, so a handle can be given out
+  // before its shot exists. Reserved slots must be added or released.
+  handle reserve();
+  void add(const projectile & shot, const projectile_owner * owner,
+           handle reserved);
+  void release(handle reserved);
+  void remove(std::size_t i);
+  void clear();
+  // Step every shot, removing those that collide or expire
+  void step(btCollisionWorld & world, float_seconds time);
+  // The same for shots from first on, shot first + i taking times[i]
+  void step(btCollisionWorld & world, std::size_t first,
+            const std::vector<float_seconds> & times);
+
+  std::size_t size() const;
+  bool empty() const;
+  // Index of the shot, or npos if it's gone or only reserved
+  std::size_t find(handle h) const;
+  handle handle_of(std::size_t i) const;
+
+  const glm::vec2 & position(std::size_t i) const;
+  const glm::vec2 & velocity(std::size_t i) const;
+  const glm::vec2 & origin(std::size_t i) const;
+  const projectile::properties & type_of(std::size_t i) const;
+  const projectile_owner * owner(std::size_t i) const;
+  const std::vector<glm::vec2> & positions() const;
+  const std::vector<glm::vec2> & velocities() const;
+
+  // Everything, handles included, for the owner's needs_snapshot
+  void save(world_snapshot & snapshot) const;
+  void restore(world_snapshot & snapshot);
 
 private:
-  glm::vec2 position__, velocity__, origin;
+  std::vector<const projectile::properties *> table;
+  // One element per shot
+  std::vector<glm::vec2> positions_, velocities_, origins_;
+  std::vector<type_index> type_indices;
+  std::vector<const projectile_owner *> owners;
+  std::vector<std::uint32_t> slots;
+  // One element per slot; dense is pending for reserved slots
+  static const std::uint32_t pending = -1;
+  std::vector<std::uint32_t> dense, generations;
+  std::vector<std::uint32_t> free_slots;
+
+  // Scratch for step: the kernel's inputs and outputs for each shot, the
+  // rays, the shot each was cast for, and which shots to remove
+  std::vector<float> range_squared, step_times;
+  std::vector<glm::vec2> targets;
+  ray_batch rays;
+  std::vector<std::uint32_t> swept;
+  std::vector<unsigned char> spent;
+  // times advances by stride after each shot
+  void sweep(btCollisionWorld & world, std::size_t first,
+             const float_seconds * times, std::size_t stride);
+};
+
+
+/*
+ * Every projectile in a world, owned by bullet_world and stepped in one pass
+ * in its projectiles phase. Shooters spawn into it from the weapons phase,
+ * which must stay serial. Shots are stepped after those already in flight,
+ * by the time left in the substep after they were fired. An owner's shots
+ * go when it's destroyed; call remove_owner if the properties of its shots
+ * go away first. Snapshots holding an owner's shots mustn't be restored
+ * after it's destroyed.
+ */
+class projectile_system : public needs_presubstep
+{
+public:
+  projectile_system();
+  projectile_system(const projectile_system &) = delete;
+  void operator = (const projectile_system &) = delete;
+  ~projectile_system();
+
+  // Queue a shot fired remainder before the end of the current substep.
+  // The handle finds it in shots() once the projectiles phase adds it.
+  // Throws std::logic_error if owner has fired into another system.
+  projectile_pool::handle spawn(const projectile_owner & owner,
+                                const projectile & shot,
+                                float_seconds remainder);
+  // Drop the owner's shots, queued and in flight
+  void remove_owner(const projectile_owner & owner);
+  void clear();
+
+  // Shots in flight; pick an owner's out with shots().owner(i)
+  const projectile_pool & shots() const;
+  std::size_t size() const;
+
+  // Called by bullet_world's save and restore
+  void save(world_snapshot & snapshot) const;
+  void restore(world_snapshot & snapshot);
+
+protected:
+  void presubstep(bullet_world & world, float_seconds substep_time) override;
+
+private:
+  class request
+  {
+  public:
+    request(const projectile_owner * owner_, const projectile & shot_,
+            float_seconds remainder_, projectile_pool::handle slot_);
+
+    const projectile_owner * owner;
+    projectile shot;
+    float_seconds remainder;
+    // Reserved in pool by spawn, and filled by presubstep
+    projectile_pool::handle slot;
+  };
+  projectile_pool pool;
+  // Kept for their capacity, so steady firing doesn't allocate
+  std::vector<request> requests;
+  std::vector<float_seconds> remainders;
+  // Every owner that has fired into this system and still exists
+  std::vector<const projectile_owner *> bound;
+
+  friend class projectile_owner;
+  void unbind(const projectile_owner & owner);
 };
 
 
@@ -63,14 +243,6 @@ public:
 };
 
 
-class needs_hit
-{
-protected:
-  virtual void hit(const hit_info & info) = 0;
-  friend class projectile;
-};
-
-
 class actor : public body, public needs_hit
 {
 public:
@@ -0,0 +1,229 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#include "projectile_kernel.h"
+#include <stdexcept>
+#include <string>
+
+
+static_assert(sizeof(glm::vec2) == 2*sizeof(float),
+              "kernels treat vec2 arrays as interleaved floats");
+
+// Shots from begin on; the vector paths finish their tails with it
+static void step_scalar(std::size_t begin, std::size_t count,
+                        const float * positions, const float * velocities,
+                        const float * origins, const float * range_squared,
+                        const float * times, float * targets,
+                        unsigned char * expired)
+{
+  for(std::size_t i = begin; i < count; ++i)
+  {
+    float x = positions[2*i], y = positions[2*i + 1];
+    float dx = x - origins[2*i], dy = y - origins[2*i + 1];
+    expired[i] = dx*dx + dy*dy > range_squared[i];
+    targets[2*i] = x + velocities[2*i]*times[i];
+    targets[2*i + 1] = y + velocities[2*i + 1]*times[i];
+  }
+}
+
+
+// Only where scalar float math is SSE too; x87 keeps excess precision, so
+// its results would differ from the vector paths
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__SSE2_MATH__) )
+#define X86_KERNELS
+#include <immintrin.h>
+
+// A shot's x and y sit in neighbouring lanes, so per-shot values (range,
+// time) are duplicated into pairs of lanes, and x*x + y*y is found by
+// adding each lane to its neighbour.
+
+__attribute__(( target("sse2") ))
+static void step_sse2(std::size_t count, const float * positions,
+                      const float * velocities, const float * origins,
+                      const float * range_squared, const float * times,
+                      float * targets, unsigned char * expired)
+{
+  std::size_t i = 0;
+  // Four shots per iteration, two per register
+  for(; i + 4 <= count; i += 4)
+  {
+    __m128 ranges = _mm_loadu_ps(range_squared + i);
+    __m128 steps = _mm_loadu_ps(times + i);
+    __m128 range[2] = { _mm_unpacklo_ps(ranges, ranges),
+                        _mm_unpackhi_ps(ranges, ranges) };
+    __m128 time[2] = { _mm_unpacklo_ps(steps, steps),
+                       _mm_unpackhi_ps(steps, steps) };
+    for(std::size_t half = 0; half != 2; ++half)
+    {
+      std::size_t at = 2*(i + 2*half);
+      __m128 position = _mm_loadu_ps(positions + at);
+      __m128 diff = _mm_sub_ps( position, _mm_loadu_ps(origins + at) );
+      __m128 square = _mm_mul_ps(diff, diff);
+      __m128 distance = _mm_add_ps( square, _mm_shuffle_ps(
+        square, square, _MM_SHUFFLE(2, 3, 0, 1)
+      ) );
+      int mask = _mm_movemask_ps( _mm_cmpgt_ps(distance, range[half]) );
+      expired[i + 2*half] = mask & 1;
+      expired[i + 2*half + 1] = (mask >> 2) & 1;
+
+      __m128 velocity = _mm_loadu_ps(velocities + at);
+      _mm_storeu_ps( targets + at,
+        _mm_add_ps( position, _mm_mul_ps(velocity, time[half]) ) );
+    }
+  }
+  step_scalar(i, count, positions, velocities, origins, range_squared, times,
+              targets, expired);
+}
+
+__attribute__(( target("avx") ))
+static void step_avx(std::size_t count, const float * positions,
+                     const float * velocities, const float * origins,
+                     const float * range_squared, const float * times,
+                     float * targets, unsigned char * expired)
+{
+  std::size_t i = 0;
+  // Eight shots per iteration, four per register
+  for(; i + 8 <= count; i += 8)
+    for(std::size_t half = 0; half != 2; ++half)
+    {
+      std::size_t first = i + 4*half;
+      __m128 ranges = _mm_loadu_ps(range_squared + first);
+      __m128 steps = _mm_loadu_ps(times + first);
+      __m256 range = _mm256_insertf128_ps(
+        _mm256_castps128_ps256( _mm_unpacklo_ps(ranges, ranges) ),
+        _mm_unpackhi_ps(ranges, ranges), 1
+      );
+      __m256 time = _mm256_insertf128_ps(
+        _mm256_castps128_ps256( _mm_unpacklo_ps(steps, steps) ),
+        _mm_unpackhi_ps(steps, steps), 1
+      );
+
+      __m256 position = _mm256_loadu_ps(positions + 2*first);
+      __m256 diff = _mm256_sub_ps( position,
+                                   _mm256_loadu_ps(origins + 2*first) );
+      __m256 square = _mm256_mul_ps(diff, diff);
+      __m256 distance = _mm256_add_ps( square, _mm256_permute_ps(
+        square, _MM_SHUFFLE(2, 3, 0, 1)
+      ) );
+      int mask = _mm256_movemask_ps(
+        _mm256_cmp_ps(distance, range, _CMP_GT_OQ)
+      );
+      for(std::size_t shot = 0; shot != 4; ++shot)
+        expired[first + shot] = (mask >> 2*shot) & 1;
+
+      __m256 velocity = _mm256_loadu_ps(velocities + 2*first);
+      _mm256_storeu_ps( targets + 2*first,
+        _mm256_add_ps( position, _mm256_mul_ps(velocity, time) ) );
+    }
+  step_scalar(i, count, positions, velocities, origins, range_squared, times,
+              targets, expired);
+}
+#endif
+
+
+bool projectile_kernel::supported(path p)
+{
+  switch(p)
+  {
+  case scalar:
+    return true;
+#ifdef X86_KERNELS
+  case sse2:
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+  case avx:
+    // Also checks that the OS saves the AVX registers
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx");
+#endif
+  default:
+    return false;
+  }
+}
+projectile_kernel::path projectile_kernel::best()
+{
+  if( supported(avx) ) return avx;
+  if( supported(sse2) ) return sse2;
+  return scalar;
+}
+const char * projectile_kernel::name(path p)
+{
+  switch(p)
+  {
+  case scalar:
+    return "scalar";
+  case sse2:
+    return "sse2";
+  case avx:
+    return "avx";
+  default:
+    return "unknown";
+  }
+}
+
+static projectile_kernel::path & current()
+{
+  static projectile_kernel::path p = projectile_kernel::best();
+  return p;
+}
+projectile_kernel::path projectile_kernel::selected()
+{
+  return current();
+}
+void projectile_kernel::select(path p)
+{
+  if( !supported(p) )
+    throw std::invalid_argument(
+      std::string("unsupported projectile kernel ") + name(p)
+    );
+  current() = p;
+}
+
+void projectile_kernel::step(std::size_t count, const glm::vec2 * positions,
+                             const glm::vec2 * velocities,
+                             const glm::vec2 * origins,
+                             const float * range_squared, const float * times,
+                             glm::vec2 * targets, unsigned char * expired)
+{
+  step(current(), count, positions, velocities, origins, range_squared, times,
+       targets, expired);
+}
+void projectile_kernel::step(path kernel, std::size_t count,
+                             const glm::vec2 * positions,
+                             const glm::vec2 * velocities,
+                             const glm::vec2 * origins,
+                             const float * range_squared, const float * times,
+                             glm::vec2 * targets, unsigned char * expired)
+{
+  const float * p = reinterpret_cast<const float *>(positions);
+  const float * v = reinterpret_cast<const float *>(velocities);
+  const float * o = reinterpret_cast<const float *>(origins);
+  float * t = reinterpret_cast<float *>(targets);
+  switch(kernel)
+  {
+#ifdef X86_KERNELS
+  case avx:
+    step_avx(count, p, v, o, range_squared, times, t, expired);
+    break;
+  case sse2:
+    step_sse2(count, p, v, o, range_squared, times, t, expired);
+    break;
+#endif
+  default:
+    step_scalar(0, count, p, v, o, range_squared, times, t, expired);
+  }
+}
@@ -0,0 +1,69 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#ifndef PROJECTILE_KERNEL_H_INCLUDED
+#define PROJECTILE_KERNEL_H_INCLUDED
+
+
+#include "glm.h"
+#include <cstddef>
+
+
+/*
+ * The arithmetic of stepping shots, over whole arrays at once: flag each
+ * shot that is farther than its range from its origin, and find where every
+ * shot moves to. Written with SSE2 and AVX as well as plain C++, and picked
+ * at run time from what the CPU supports. Every path does the same float
+ * operations in the same order, so results are identical and lockstep peers
+ * on mixed hardware stay in sync, as long as the build doesn't fuse
+ * multiplies and adds (e.g. -mfma). The vector paths are only built where
+ * scalar math is SSE as well: x86-64, or 32 bit x86 with -msse2
+ * -mfpmath=sse. Elsewhere, including x87 builds, only scalar is supported.
+ */
+class projectile_kernel
+{
+public:
+  enum path {scalar, sse2, avx};
+
+  // Whether this CPU and build can run the path
+  static bool supported(path p);
+  // Fastest supported path
+  static path best();
+  static const char * name(path p);
+
+  // The path step uses, initially best(). Throws std::invalid_argument if
+  // unsupported. Select before stepping worlds on other threads.
+  static path selected();
+  static void select(path p);
+
+  // For each of count shots, expired is set to 1 if the shot is farther
+  // than range_squared from its origin and 0 otherwise, and target to
+  // position + velocity*time
+  static void step(std::size_t count, const glm::vec2 * positions,
+                   const glm::vec2 * velocities, const glm::vec2 * origins,
+                   const float * range_squared, const float * times,
+                   glm::vec2 * targets, unsigned char * expired);
+  // The same with a given path, e.g. to compare them
+  static void step(path kernel, std::size_t count,
+                   const glm::vec2 * positions, const glm::vec2 * velocities,
+                   const glm::vec2 * origins,
+                   const float * range_squared, const float * times,
+                   glm::vec2 * targets, unsigned char * expired);
+};
+
+
+#endif  // PROJECTILE_KERNEL_H_INCLUDED
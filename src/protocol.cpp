@@ -0,0 +1,167 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#include "protocol.h"
+
+
+packet_writer::packet_writer(std::vector<unsigned char> & buffer_)
+: buffer(buffer_)
+{}
+void packet_writer::u8(std::uint8_t value)
+{
+  buffer.push_back(value);
+}
+void packet_writer::u16(std::uint16_t value)
+{
+  buffer.push_back(value & 0xff);
+  buffer.push_back(value >> 8);
+}
+void packet_writer::u32(std::uint32_t value)
+{
+  for(int i = 0; i < 4; ++i)
+    buffer.push_back( (value >> 8*i) & 0xff );
+}
+#include <cstring>
+void packet_writer::f32(float value)
+{
+  static_assert(sizeof(float) == 4, "floats must be 32 bits");
+  std::uint32_t bits;
+  std::memcpy( &bits, &value, sizeof(bits) );
+  u32(bits);
+}
+
+
+packet_reader::packet_reader(const unsigned char * data_, std::size_t size_)
+: data(data_), size(size_)
+{}
+#include <stdexcept>
+const unsigned char * packet_reader::take(std::size_t count)
+{
+  if(count > size) throw std::out_of_range("packet too short");
+  const unsigned char * bytes = data;
+  data += count;
+  size -= count;
+  return bytes;
+}
+std::uint8_t packet_reader::u8()
+{
+  return *take(1);
+}
+std::uint16_t packet_reader::u16()
+{
+  const unsigned char * bytes = take(2);
+  return bytes[0] | bytes[1] << 8;
+}
+std::uint32_t packet_reader::u32()
+{
+  const unsigned char * bytes = take(4);
+  std::uint32_t value = 0;
+  for(int i = 0; i < 4; ++i)
+    value |= std::uint32_t(bytes[i]) << 8*i;
+  return value;
+}
+float packet_reader::f32()
+{
+  std::uint32_t bits = u32();
+  float value;
+  std::memcpy( &value, &bits, sizeof(value) );
+  return value;
+}
+std::size_t packet_reader::remaining() const
+{
+  return size;
+}
+const unsigned char * packet_reader::cursor() const
+{
+  return data;
+}
+
+
+input_message::input_message()
+: sequence(0),
+  has_frame(false),
+  frame(0),
+  view_radius(0.0f)
+{}
+enum input_flags : std::uint8_t {fire_flag = 1, frame_flag = 2};
+void input_message::write(packet_writer & packet) const
+{
+  packet.u8( static_cast<std::uint8_t>(message_type::input) );
+  packet.u32(sequence);
+  packet.f32(controls.movement.x);
+  packet.f32(controls.movement.y);
+  packet.f32(controls.aim.x);
+  packet.f32(controls.aim.y);
+  packet.f32(view_radius);
+  packet.u8( (controls.fire ? fire_flag : 0) | (has_frame ? frame_flag : 0) );
+  if(has_frame) packet.u16(frame);
+}
+#include <cmath>
+static float sanitize(float value, float limit)
+{
+  if( !std::isfinite(value) ) return 0.0f;
+  return glm::clamp(value, -limit, limit);
+}
+void input_message::read(packet_reader & packet)
+{
+  // The caller has already read the message type
+  sequence = packet.u32();
+  controls.movement.x = sanitize(packet.f32(), 1.0f);
+  controls.movement.y = sanitize(packet.f32(), 1.0f);
+  // Only the aim direction matters
+  controls.aim.x = sanitize(packet.f32(), 1.0e6f);
+  controls.aim.y = sanitize(packet.f32(), 1.0e6f);
+  view_radius = std::abs( sanitize(packet.f32(), 1.0e6f) );
+  std::uint8_t flags = packet.u8();
+  controls.fire = flags & fire_flag;
+  has_frame = flags & frame_flag;
+  if(has_frame) frame = packet.u16();
+}
+
+
+state_header::state_header()
+: tick(0), ack(0), avatar(0)
+{}
+void state_header::write(packet_writer & packet) const
+{
+  packet.u8( static_cast<std::uint8_t>(message_type::state) );
+  packet.u32(tick);
+  packet.u32(ack);
+  packet.u32(avatar);
+}
+void state_header::read(packet_reader & packet)
+{
+  // The caller has already read the message type
+  tick = packet.u32();
+  ack = packet.u32();
+  avatar = packet.u32();
+}
+
+
+body_state::body_state()
+: id(0), position(0.0f, 0.0f), angle(0.0f), velocity(0.0f, 0.0f),
+  angular_velocity(0.0f)
+{}
+body_state::body_state(const body & b)
+: id( b.id() ),
+  position( b.position() ),
+  angle( angle_from_mat2( b.orientation() ) )
+{
+  const btVector3 & v = b.getLinearVelocity();
+  velocity = glm::vec2( v.x(), v.y() );
+  angular_velocity = b.getAngularVelocity().z();
+}
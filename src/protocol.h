@@ -0,0 +1,135 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#ifndef PROTOCOL_H_INCLUDED
+#define PROTOCOL_H_INCLUDED
+
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+/*
+ * Datagram encoding shared by tdse_server and its clients. Integers are
+ * little-endian and floats are IEEE 754 single precision, whatever the host.
+ */
+class packet_writer
+{
+public:
+  // Appends to buffer_, which must outlive the writer
+  packet_writer(std::vector<unsigned char> & buffer_);
+
+  void u8(std::uint8_t value);
+  void u16(std::uint16_t value);
+  void u32(std::uint32_t value);
+  void f32(float value);
+
+private:
+  std::vector<unsigned char> & buffer;
+};
+class packet_reader
+{
+public:
+  packet_reader(const unsigned char * data_, std::size_t size_);
+
+  // Each throws std::out_of_range when the packet is too short
+  std::uint8_t u8();
+  std::uint16_t u16();
+  std::uint32_t u32();
+  float f32();
+
+  std::size_t remaining() const;
+  // Next unread byte, for handing the rest to another decoder
+  const unsigned char * cursor() const;
+
+private:
+  const unsigned char * data;
+  std::size_t size;
+
+  const unsigned char * take(std::size_t count);
+};
+
+
+#include "input.h"
+enum class message_type : std::uint8_t
+{
+  // Client to server
+  input = 1,
+  // Server to client
+  state = 2
+};
+
+// Sent by clients every tick. Only the newest sequence number is applied.
+class input_message
+{
+public:
+  input_message();
+
+  std::uint32_t sequence;
+  player controls;
+  // Newest replication frame the client decoded, if it has decoded any
+  bool has_frame;
+  std::uint16_t frame;
+  // How far the client can see (see view_radius in interest.h), or zero to
+  // leave it to the server
+  float view_radius;
+
+  void write(packet_writer & packet) const;
+  // Out-of-range or non-finite controls are clamped or zeroed, since they
+  // come straight off the network
+  void read(packet_reader & packet);
+};
+
+// Starts each state datagram, followed by one replication frame
+class state_header
+{
+public:
+  state_header();
+
+  std::uint32_t tick;
+  // Newest input sequence the server has applied for this client
+  std::uint32_t ack;
+  // Id of the body this client controls
+  std::uint32_t avatar;
+
+  void write(packet_writer & packet) const;
+  void read(packet_reader & packet);
+};
+
+// What replication sends of each body; see replication.h
+#include "physics.h"
+class body_state
+{
+public:
+  body_state();
+  body_state(const body & b);
+
+  std::uint32_t id;
+  glm::vec2 position;
+  float angle;
+  glm::vec2 velocity;
+  // Radians per second about z
+  float angular_velocity;
+};
+
+// Largest encoded size of each message, for sizing datagrams
+constexpr std::size_t input_message_size = 1 + 4 + 4*4 + 4 + 1 + 2;
+constexpr std::size_t state_header_size = 1 + 4*3;
+
+
+#endif  // PROTOCOL_H_INCLUDED
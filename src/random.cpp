@@ -0,0 +1,47 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#include "random.h"
+#include <cmath>
+#include <cstdint>
+
+
+static const std::int64_t engine_range =
+  std::int64_t(random_engine::max() - random_engine::min()) + 1;
+
+uniform_variate::uniform_variate(float min_, float max_)
+: min(min_), max(max_)
+{}
+float uniform_variate::operator () (random_engine & prand) const
+{
+  double unit = double(prand() - random_engine::min())/engine_range;
+  float value = min + (max - min)*float(unit);
+  // Rounding can reach max itself
+  return value < max ? value : std::nextafter(max, min);
+}
+
+normal_variate::normal_variate(float mean_, float stddev_)
+: mean(mean_), stddev(stddev_)
+{}
+float normal_variate::operator () (random_engine & prand) const
+{
+  // Exact in 64 bits, then one division
+  std::int64_t sum = 0;
+  for(int i = 0; i != 12; ++i)
+    sum += prand() - random_engine::min();
+  return mean + stddev*float( double(sum - 6*engine_range)/engine_range );
+}
@@ -0,0 +1,57 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#ifndef RANDOM_H_INCLUDED
+#define RANDOM_H_INCLUDED
+
+
+#include <random>
+
+
+// Unlike std::default_random_engine, its output is the same everywhere, so
+// seeded simulations replay identically across standard libraries
+typedef std::minstd_rand random_engine;
+
+/*
+ * The standard distributions' algorithms are up to the library, so these
+ * stand in for them where results must match across platforms. They use
+ * only integer and basic float arithmetic, which IEEE 754 pins down, and
+ * keep no state between draws.
+ */
+class uniform_variate
+{
+public:
+  // Floats in [min_, max_)
+  uniform_variate(float min_, float max_);
+  float operator () (random_engine & prand) const;
+
+  float min, max;
+};
+
+// Sums twelve uniform draws (Irwin-Hall), which is normal to within a few
+// percent and never strays past six standard deviations
+class normal_variate
+{
+public:
+  normal_variate(float mean_, float stddev_);
+  float operator () (random_engine & prand) const;
+
+  float mean, stddev;
+};
+
+
+#endif  // RANDOM_H_INCLUDED
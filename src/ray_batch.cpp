@@ -0,0 +1,156 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#include "ray_batch.h"
+#include "trace.h"
+
+
+ray_batch::entry::entry(const btDbvtNode * node_, std::size_t begin_,
+                        std::size_t end_)
+: node(node_), begin(begin_), end(end_)
+{}
+
+
+ray_batch::ray_batch()
+{}
+
+void ray_batch::clear()
+{
+  results.clear();
+  from_x.clear();
+  from_y.clear();
+  inverse_x.clear();
+  inverse_y.clear();
+  limit.clear();
+}
+std::size_t ray_batch::add(const glm::vec2 & from, const glm::vec2 & to)
+{
+  btVector3 bt_from(from.x, from.y, 0.0f), bt_to(to.x, to.y, 0.0f);
+  results.emplace_back(bt_from, bt_to);
+
+  // Axis-parallel rays get a huge inverse rather than infinity, so a ray
+  // lying on a box's edge gives 0 rather than NaN
+  glm::vec2 direction = to - from;
+  from_x.push_back(from.x);
+  from_y.push_back(from.y);
+  inverse_x.push_back( direction.x == 0.0f ?
+                       BT_LARGE_FLOAT : 1.0f/direction.x );
+  inverse_y.push_back( direction.y == 0.0f ?
+                       BT_LARGE_FLOAT : 1.0f/direction.y );
+  limit.push_back(1.0f);
+  return results.size() - 1;
+}
+std::size_t ray_batch::size() const
+{
+  return results.size();
+}
+
+void ray_batch::cast(btCollisionWorld & world)
+{
+  trace_scope trace( "rays", size() );
+  btDbvtBroadphase * dbvt =
+    dynamic_cast<btDbvtBroadphase *>( world.getBroadphase() );
+  if(!dbvt)
+  {
+    for(auto i = results.begin(); i != results.end(); ++i)
+      world.rayTest(i->m_rayFromWorld, i->m_rayToWorld, *i);
+    return;
+  }
+
+  // Moving and resting proxies are kept in separate trees
+  traverse(dbvt->m_sets[0].m_root);
+  traverse(dbvt->m_sets[1].m_root);
+}
+const ray_batch::result_type & ray_batch::result(std::size_t i) const
+{
+  return results[i];
+}
+
+#include <algorithm>
+void ray_batch::traverse(const btDbvtNode * root)
+{
+  if( !root || results.empty() ) return;
+
+  active.resize( size() );
+  for(std::size_t i = 0; i != active.size(); ++i)
+    active[i] = i;
+  stack.clear();
+  stack.emplace_back( root, 0, active.size() );
+
+  while( !stack.empty() )
+  {
+    entry e = stack.back();
+    stack.pop_back();
+    // Anything past the parent's rays belonged to a finished sibling
+    active.resize(e.end);
+
+    // Keep the rays crossing the node's box before their closest hit. Only
+    // x and y are tested, since every ray lies at z = 0.
+    const btVector3 & mins = e.node->volume.Mins();
+    const btVector3 & maxs = e.node->volume.Maxs();
+    const float min_x = mins.getX(), min_y = mins.getY(),
+                max_x = maxs.getX(), max_y = maxs.getY();
+    std::size_t begin = active.size();
+    active.resize( begin + (e.end - e.begin) );
+    std::size_t end = begin;
+    for(std::size_t i = e.begin; i != e.end; ++i)
+    {
+      std::uint32_t ray = active[i];
+      float x0 = (min_x - from_x[ray])*inverse_x[ray],
+            x1 = (max_x - from_x[ray])*inverse_x[ray],
+            y0 = (min_y - from_y[ray])*inverse_y[ray],
+            y1 = (max_y - from_y[ray])*inverse_y[ray];
+      float enter = std::max( std::min(x0, x1), std::min(y0, y1) ),
+            leave = std::min( std::max(x0, x1), std::max(y0, y1) );
+      // Written unconditionally and kept by advancing end, since whether a
+      // ray crosses is too unpredictable to branch on
+      active[end] = ray;
+      end += (enter <= leave) & (leave >= 0.0f) & (enter <= limit[ray]);
+    }
+    active.resize(end);
+    if(begin == end) continue;
+
+    if( e.node->isleaf() ) test_leaf(e.node, begin, end);
+    else
+    {
+      stack.emplace_back(e.node->childs[0], begin, end);
+      stack.emplace_back(e.node->childs[1], begin, end);
+    }
+  }
+}
+void ray_batch::test_leaf(const btDbvtNode * leaf, std::size_t begin,
+                          std::size_t end)
+{
+  btBroadphaseProxy * proxy = static_cast<btBroadphaseProxy *>(leaf->data);
+  btCollisionObject * object =
+    static_cast<btCollisionObject *>(proxy->m_clientObject);
+  btTransform from, to;
+  from.setIdentity();
+  to.setIdentity();
+  for(std::size_t i = begin; i != end; ++i)
+  {
+    std::uint32_t ray = active[i];
+    result_type & result = results[ray];
+    if( !result.needsCollision(proxy) ) continue;
+    from.setOrigin(result.m_rayFromWorld);
+    to.setOrigin(result.m_rayToWorld);
+    btCollisionWorld::rayTestSingle( from, to, object,
+                                     object->getCollisionShape(),
+                                     object->getWorldTransform(), result );
+    limit[ray] = result.m_closestHitFraction;
+  }
+}
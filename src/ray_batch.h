@@ -0,0 +1,74 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#ifndef RAY_BATCH_H_INCLUDED
+#define RAY_BATCH_H_INCLUDED
+
+
+#include "physics.h"
+#include <cstdint>
+#include <vector>
+
+
+/*
+ * Closest-hit ray casts for many segments on the XY plane at once, as
+ * projectiles make every substep. With btDbvtBroadphase each tree is walked
+ * once for the whole batch: a node is tested against every ray that reached
+ * its parent, and only the rays crossing it before their closest hit so far
+ * go further down. Other broadphases get one btCollisionWorld::rayTest per
+ * ray. Buffers keep their capacity, so a steady batch size doesn't allocate.
+ */
+class ray_batch
+{
+public:
+  typedef btCollisionWorld::ClosestRayResultCallback result_type;
+
+  ray_batch();
+
+  void clear();
+  // Returns the ray's index
+  std::size_t add(const glm::vec2 & from, const glm::vec2 & to);
+  std::size_t size() const;
+
+  // Cast every ray added since clear
+  void cast(btCollisionWorld & world);
+  // m_collisionObject is null if the ray hit nothing
+  const result_type & result(std::size_t i) const;
+
+private:
+  std::vector<result_type> results;
+  // Per ray, laid out for node tests. Limit is the closest hit fraction.
+  std::vector<float> from_x, from_y, inverse_x, inverse_y, limit;
+
+  class entry
+  {
+  public:
+    entry(const btDbvtNode * node_, std::size_t begin_, std::size_t end_);
+
+    const btDbvtNode * node;
+    // Rays that reached the parent, as a range of active
+    std::size_t begin, end;
+  };
+  std::vector<entry> stack;
+  std::vector<std::uint32_t> active;
+
+  void traverse(const btDbvtNode * root);
+  void test_leaf(const btDbvtNode * leaf, std::size_t begin, std::size_t end);
+};
+
+
+#endif  // RAY_BATCH_H_INCLUDED
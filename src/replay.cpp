@@ -0,0 +1,173 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#include "replay.h"
+#include "protocol.h"
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+
+static const char magic[4] = {'T', 'D', 'S', 'R'};
+static const std::uint16_t version = 1;
+static const std::size_t flush_size = 1 << 16;
+
+
+replay_header::replay_header()
+: seed(0)
+{}
+
+
+replay_writer::replay_writer(const std::string & path,
+                             const replay_header & header)
+: file(path, std::ios::binary | std::ios::trunc)
+{
+  if(!file) throw std::runtime_error("can't create replay file " + path);
+  buffer.reserve(flush_size*2);
+  buffer.insert( buffer.end(), magic, magic + sizeof(magic) );
+  packet_writer packet(buffer);
+  packet.u16(version);
+  packet.u32(header.seed);
+  packet.f32( header.options.substep.count() );
+  packet.f32(header.options.grid_cell_size);
+  packet.u8(header.options.deterministic);
+  packet.u16(header.options.threads);
+}
+replay_writer::~replay_writer()
+{
+  flush();
+}
+
+void replay_writer::spawn(std::uint32_t serial)
+{
+  packet_writer packet(buffer);
+  packet.u8(replay_event::spawn);
+  packet.u32(serial);
+  flush_if_full();
+}
+void replay_writer::despawn(std::uint32_t serial)
+{
+  packet_writer packet(buffer);
+  packet.u8(replay_event::despawn);
+  packet.u32(serial);
+  flush_if_full();
+}
+void replay_writer::input(std::uint32_t serial, const player & controls)
+{
+  packet_writer packet(buffer);
+  packet.u8(replay_event::input);
+  packet.u32(serial);
+  packet.f32(controls.movement.x);
+  packet.f32(controls.movement.y);
+  packet.f32(controls.aim.x);
+  packet.f32(controls.aim.y);
+  packet.u8(controls.fire);
+  flush_if_full();
+}
+void replay_writer::end_tick()
+{
+  buffer.push_back(replay_event::tick);
+  flush_if_full();
+}
+
+void replay_writer::flush()
+{
+  file.write( reinterpret_cast<const char *>( buffer.data() ),
+              buffer.size() );
+  file.flush();
+  buffer.clear();
+}
+void replay_writer::flush_if_full()
+{
+  if(buffer.size() >= flush_size) flush();
+}
+
+
+replay_reader::replay_reader(const std::string & path)
+: position(0)
+{
+  std::ifstream file(path, std::ios::binary);
+  if(!file) throw std::runtime_error("can't open replay file " + path);
+  data.assign( std::istreambuf_iterator<char>(file),
+               std::istreambuf_iterator<char>() );
+
+  try
+  {
+    if( data.size() < sizeof(magic) ||
+        std::memcmp( data.data(), magic, sizeof(magic) ) )
+      throw std::runtime_error(path + " is not a replay");
+    packet_reader packet( data.data() + sizeof(magic),
+                          data.size() - sizeof(magic) );
+    if(packet.u16() != version)
+      throw std::runtime_error(path + " is from another replay version");
+    header_.seed = packet.u32();
+    header_.options.substep = float_seconds( packet.f32() );
+    header_.options.grid_cell_size = packet.f32();
+    header_.options.deterministic = packet.u8() != 0;
+    header_.options.threads = packet.u16();
+    position = data.size() - packet.remaining();
+  }
+  catch(const std::out_of_range &)
+  {
+    throw std::runtime_error(path + " is truncated");
+  }
+}
+
+const replay_header & replay_reader::header() const
+{
+  return header_;
+}
+
+bool replay_reader::next(replay_event & event)
+{
+  if( position == data.size() ) return false;
+  packet_reader packet(data.data() + position, data.size() - position);
+  try
+  {
+    switch( packet.u8() )
+    {
+    case replay_event::tick:
+      event.type = replay_event::tick;
+      break;
+    case replay_event::spawn:
+      event.type = replay_event::spawn;
+      event.serial = packet.u32();
+      break;
+    case replay_event::despawn:
+      event.type = replay_event::despawn;
+      event.serial = packet.u32();
+      break;
+    case replay_event::input:
+      event.type = replay_event::input;
+      event.serial = packet.u32();
+      event.controls.movement.x = packet.f32();
+      event.controls.movement.y = packet.f32();
+      event.controls.aim.x = packet.f32();
+      event.controls.aim.y = packet.f32();
+      event.controls.fire = packet.u8() != 0;
+      break;
+    default:
+      throw std::runtime_error("bad event in replay");
+    }
+  }
+  catch(const std::out_of_range &)
+  {
+    throw std::runtime_error("replay ends partway through an event");
+  }
+  position = data.size() - packet.remaining();
+  return true;
+}
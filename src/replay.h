@@ -0,0 +1,97 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#ifndef REPLAY_H_INCLUDED
+#define REPLAY_H_INCLUDED
+
+
+#include "input.h"
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+
+/*
+ * Replay files hold the seed and world options a game started with, then
+ * what happened each tick: soldiers spawned and despawned (by spawn order)
+ * and player input, written only when it changes. Encoded as in
+ * protocol.h, so files move between machines.
+ */
+class replay_header
+{
+public:
+  replay_header();
+
+  std::uint32_t seed;
+  // Only the options that change results are kept
+  world_options options;
+};
+
+class replay_writer
+{
+public:
+  // Throws std::runtime_error if the file can't be created
+  replay_writer(const std::string & path, const replay_header & header);
+  // Flushes what's left
+  ~replay_writer();
+  replay_writer(const replay_writer &) = delete;
+  void operator = (const replay_writer &) = delete;
+
+  void spawn(std::uint32_t serial);
+  void despawn(std::uint32_t serial);
+  void input(std::uint32_t serial, const player & controls);
+  void end_tick();
+  void flush();
+
+private:
+  std::ofstream file;
+  std::vector<unsigned char> buffer;
+
+  void flush_if_full();
+};
+
+class replay_event
+{
+public:
+  enum type_id {tick, spawn, despawn, input};
+
+  type_id type;
+  std::uint32_t serial;
+  // Only for input events
+  player controls;
+};
+
+class replay_reader
+{
+public:
+  // Reads the whole file. Throws std::runtime_error if it can't be read or
+  // isn't a replay.
+  replay_reader(const std::string & path);
+
+  const replay_header & header() const;
+  // False at the end. Throws std::runtime_error on a damaged file.
+  bool next(replay_event & event);
+
+private:
+  std::vector<unsigned char> data;
+  std::size_t position;
+  replay_header header_;
+};
+
+
+#endif  // REPLAY_H_INCLUDED
@@ -0,0 +1,538 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#include "replication.h"
+#include <algorithm>
+#include <stdexcept>
+
+
+bit_writer::bit_writer(std::vector<unsigned char> & buffer_)
+: buffer(buffer_),
+  bits_(0)
+{}
+void bit_writer::write(std::uint32_t value, int bits)
+{
+  if(bits < 32) value &= (std::uint32_t(1) << bits) - 1;
+  while(bits > 0)
+  {
+    int offset = bits_ % 8;
+    if(offset == 0) buffer.push_back(0);
+    int count = std::min(bits, 8 - offset);
+    buffer.back() |= static_cast<unsigned char>(
+      (value & ( (1u << count) - 1 )) << offset
+    );
+    value >>= count;
+    bits -= count;
+    bits_ += count;
+  }
+}
+void bit_writer::write_bool(bool value)
+{
+  write(value, 1);
+}
+static const int width_class[4] = {4, 8, 16, 32};
+static std::uint32_t class_of(std::uint32_t value)
+{
+  return value < 0x10 ? 0 : value < 0x100 ? 1 : value < 0x10000 ? 2 : 3;
+}
+static std::uint32_t zigzag(std::int32_t value)
+{
+  return static_cast<std::uint32_t>(value) << 1 ^
+         static_cast<std::uint32_t>(value >> 31);
+}
+void bit_writer::write_unsigned(std::uint32_t value)
+{
+  std::uint32_t c = class_of(value);
+  write(c, 2);
+  write(value, width_class[c]);
+}
+void bit_writer::write_signed(std::int32_t value)
+{
+  write_unsigned( zigzag(value) );
+}
+static std::size_t unsigned_bits(std::uint32_t value)
+{
+  return 2 + width_class[class_of(value)];
+}
+static std::size_t signed_bits(std::int32_t value)
+{
+  return unsigned_bits( zigzag(value) );
+}
+std::size_t bit_writer::bits() const
+{
+  return bits_;
+}
+
+
+bit_reader::bit_reader(const unsigned char * data_, std::size_t size)
+: data(data_),
+  size_bits(size*8),
+  position(0)
+{}
+std::uint32_t bit_reader::read(int bits)
+{
+  if( std::size_t(bits) > size_bits - position )
+    throw std::out_of_range("read past the end of a bit stream");
+  std::uint32_t value = 0;
+  int shift = 0;
+  while(bits > 0)
+  {
+    int offset = position % 8;
+    int count = std::min(bits, 8 - offset);
+    std::uint32_t chunk = (data[position/8] >> offset) & ( (1u << count) - 1 );
+    value |= chunk << shift;
+    shift += count;
+    position += count;
+    bits -= count;
+  }
+  return value;
+}
+bool bit_reader::read_bool()
+{
+  return read(1) != 0;
+}
+std::uint32_t bit_reader::read_unsigned()
+{
+  return read( width_class[read(2)] );
+}
+std::int32_t bit_reader::read_signed()
+{
+  std::uint32_t zigzag = read_unsigned();
+  return static_cast<std::int32_t>( zigzag >> 1 ^ (~(zigzag & 1) + 1) );
+}
+
+
+#include <glm/gtc/constants.hpp>
+replication_format::replication_format()
+: position_scale(256.0f),
+  angle_bits(14),
+  velocity_scale(64.0f),
+  velocity_limit(1024.0f),
+  angular_velocity_scale(256.0f),
+  angular_velocity_limit(256.0f)
+{}
+float replication_format::position_error() const
+{
+  return 0.5f/position_scale;
+}
+float replication_format::angle_error() const
+{
+  return glm::pi<float>()/(1 << angle_bits);
+}
+float replication_format::velocity_error() const
+{
+  return 0.5f/velocity_scale;
+}
+float replication_format::angular_velocity_error() const
+{
+  return 0.5f/angular_velocity_scale;
+}
+
+
+#include <cmath>
+// Keeps differences between quantized values within 32 bits
+static const float quantized_limit = 1 << 29;
+static std::int32_t quantize(float value, float scale, float limit)
+{
+  float q = value*scale;
+  if( !(q > -limit) ) q = -limit;
+  else if(q > limit) q = limit;
+  return std::lround(q);
+}
+
+replicated_body::replicated_body()
+: id(0), x(0), y(0), angle(0), vx(0), vy(0), spin(0)
+{}
+replicated_body::replicated_body(const body_state & state,
+                                 const replication_format & format)
+: id(state.id),
+  x( quantize(state.position.x, format.position_scale, quantized_limit) ),
+  y( quantize(state.position.y, format.position_scale, quantized_limit) ),
+  vx( quantize(state.velocity.x, format.velocity_scale,
+               format.velocity_limit*format.velocity_scale) ),
+  vy( quantize(state.velocity.y, format.velocity_scale,
+               format.velocity_limit*format.velocity_scale) ),
+  spin( quantize(state.angular_velocity, format.angular_velocity_scale,
+                 format.angular_velocity_limit*format.angular_velocity_scale) )
+{
+  const float revolution = 2*glm::pi<float>();
+  float turns = std::isfinite(state.angle) ? state.angle/revolution : 0.0f;
+  turns -= std::floor(turns);
+  long steps = std::lround( turns*(1 << format.angle_bits) );
+  angle = static_cast<std::uint32_t>(steps) & ( (1u << format.angle_bits) - 1 );
+}
+body_state replicated_body::state(const replication_format & format) const
+{
+  body_state s;
+  s.id = id;
+  s.position = glm::vec2(x, y)/format.position_scale;
+  s.angle = angle*( 2*glm::pi<float>() )/(1 << format.angle_bits);
+  if( s.angle > glm::pi<float>() ) s.angle -= 2*glm::pi<float>();
+  s.velocity = glm::vec2(vx, vy)/format.velocity_scale;
+  s.angular_velocity = spin/format.angular_velocity_scale;
+  return s;
+}
+bool replicated_body::operator == (const replicated_body & other) const
+{
+  return id == other.id && x == other.x && y == other.y &&
+         angle == other.angle && vx == other.vx && vy == other.vy &&
+         spin == other.spin;
+}
+bool replicated_body::operator != (const replicated_body & other) const
+{
+  return !(*this == other);
+}
+
+
+enum entry_kind : std::uint32_t {delta_entry, full_entry, removed_entry};
+
+// Differences wrap around a revolution, so take the shorter way
+static std::int32_t angle_delta(std::uint32_t to, std::uint32_t from,
+                                int bits)
+{
+  std::uint32_t d = (to - from) << (32 - bits);
+  return static_cast<std::int32_t>(d) >> (32 - bits);
+}
+
+replication_encoder::frame::frame()
+: sequence(0),
+  valid(false)
+{}
+replication_encoder::replication_encoder(const replication_format & format_)
+: format(format_),
+  frames(history),
+  next_sequence(0),
+  acknowledged(false),
+  baseline(0)
+{}
+
+// Size of an entry after its id gap and kind, and the entry itself
+static std::size_t payload_bits(const replicated_body * before,
+                                const replicated_body * now,
+                                const replication_format & format)
+{
+  if(!now) return 0;
+  if(!before)
+    return signed_bits(now->x) + signed_bits(now->y) + format.angle_bits +
+           signed_bits(now->vx) + signed_bits(now->vy) +
+           signed_bits(now->spin);
+  std::size_t bits = 4;
+  if(now->x != before->x || now->y != before->y)
+    bits += signed_bits(now->x - before->x) + signed_bits(now->y - before->y);
+  if(now->angle != before->angle)
+    bits += signed_bits( angle_delta(now->angle, before->angle,
+                                     format.angle_bits) );
+  if(now->vx != before->vx || now->vy != before->vy)
+    bits += signed_bits(now->vx - before->vx) +
+            signed_bits(now->vy - before->vy);
+  if(now->spin != before->spin)
+    bits += signed_bits(now->spin - before->spin);
+  return bits;
+}
+static void write_payload(bit_writer & bits, const replicated_body * before,
+                          const replicated_body * now,
+                          const replication_format & format)
+{
+  if(!now) return;
+  if(!before)
+  {
+    bits.write_signed(now->x);
+    bits.write_signed(now->y);
+    bits.write(now->angle, format.angle_bits);
+    bits.write_signed(now->vx);
+    bits.write_signed(now->vy);
+    bits.write_signed(now->spin);
+    return;
+  }
+  bool moved = now->x != before->x || now->y != before->y;
+  bool turned = now->angle != before->angle;
+  bool accelerated = now->vx != before->vx || now->vy != before->vy;
+  bits.write_bool(moved);
+  bits.write_bool(turned);
+  bool spun = now->spin != before->spin;
+  bits.write_bool(accelerated);
+  bits.write_bool(spun);
+  if(moved)
+  {
+    bits.write_signed(now->x - before->x);
+    bits.write_signed(now->y - before->y);
+  }
+  if(turned)
+    bits.write_signed( angle_delta(now->angle, before->angle,
+                                   format.angle_bits) );
+  if(accelerated)
+  {
+    bits.write_signed(now->vx - before->vx);
+    bits.write_signed(now->vy - before->vy);
+  }
+  if(spun)
+    bits.write_signed(now->spin - before->spin);
+}
+static std::size_t entry_bits(std::uint32_t gap, const replicated_body * before,
+                              const replicated_body * now,
+                              const replication_format & format)
+{
+  return 1 + unsigned_bits(gap) + 2 + payload_bits(before, now, format);
+}
+
+#include <numeric>
+std::uint16_t replication_encoder::encode
+(const std::vector<body_state> & states, std::vector<unsigned char> & out,
+ std::size_t max_bytes)
+{
+  current.clear();
+  for(auto i = states.begin(); i != states.end(); ++i)
+    current.emplace_back(*i, format);
+  by_id.resize( current.size() );
+  std::iota(by_id.begin(), by_id.end(), 0);
+  std::sort( by_id.begin(), by_id.end(),
+    [this](std::size_t a, std::size_t b)
+    {
+      return current[a].id < current[b].id;
+    }
+  );
+
+  const std::uint16_t sequence = next_sequence++;
+  // The baseline must still be remembered, and not in the slot about to be
+  // overwritten
+  const frame * base = nullptr;
+  if(acknowledged && baseline % history != sequence % history)
+  {
+    const frame & f = frames[baseline % history];
+    if(f.valid && f.sequence == baseline) base = &f;
+  }
+  static const std::vector<replicated_body> none;
+  const std::vector<replicated_body> & old = base ? base->bodies : none;
+  frame & next = frames[sequence % history];
+  next.sequence = sequence;
+  next.valid = true;
+  next.bodies.clear();
+
+  // Pair each body with its baseline, in id order
+  const std::size_t header_bits = 16 + 1 + (base ? 16 : 0);
+  std::size_t total = header_bits + 1;
+  std::uint32_t previous_id = 0;
+  bool first = true;
+  events.clear();
+  auto i = old.begin();
+  auto j = by_id.begin();
+  while( i != old.end() || j != by_id.end() )
+  {
+    event e;
+    if( i == old.end() ||
+        (j != by_id.end() && current[*j].id < i->id) )
+    {
+      e.before = nullptr;
+      e.now = &current[*j];
+      e.rank = *j++;
+    }
+    else if( j == by_id.end() || i->id < current[*j].id )
+    {
+      // Removals are cheap and free the receiver's memory, so they go first
+      e.before = &*i++;
+      e.now = nullptr;
+      e.rank = 0;
+    }
+    else
+    {
+      e.before = &*i++;
+      e.now = &current[*j];
+      e.rank = *j++;
+    }
+
+    e.send = !e.before || !e.now || *e.before != *e.now;
+    e.bits = 0;
+    if(e.send)
+    {
+      std::uint32_t id = e.now ? e.now->id : e.before->id;
+      e.bits = entry_bits(first ? id : id - previous_id - 1, e.before, e.now,
+                          format);
+      total += e.bits;
+      previous_id = id;
+      first = false;
+    }
+    events.push_back(e);
+  }
+
+  // Over budget, so hold back the least important changes
+  const std::size_t budget = max_bytes*8;
+  if(total > budget)
+  {
+    by_rank.clear();
+    for(std::size_t k = 0; k != events.size(); ++k)
+      if(events[k].send) by_rank.push_back(k);
+    std::stable_sort( by_rank.begin(), by_rank.end(),
+      [this](std::size_t a, std::size_t b)
+      {
+        return events[a].rank < events[b].rank;
+      }
+    );
+    std::size_t used = header_bits + 1;
+    for(auto k = by_rank.begin(); k != by_rank.end(); ++k)
+      if(used + events[*k].bits <= budget) used += events[*k].bits;
+      else events[*k].send = false;
+  }
+
+  bit_writer bits(out);
+  bits.write(sequence, 16);
+  bits.write_bool(base != nullptr);
+  if(base) bits.write(baseline, 16);
+  previous_id = 0;
+  first = true;
+  for(auto e = events.begin(); e != events.end(); ++e)
+  {
+    if(e->send)
+    {
+      std::uint32_t id = e->now ? e->now->id : e->before->id;
+      std::uint32_t gap = first ? id : id - previous_id - 1;
+      // Held-back entries can widen the gaps after them, so check again
+      if(bits.bits() + entry_bits(gap, e->before, e->now, format) + 1 >
+         budget)
+        e->send = false;
+      else
+      {
+        bits.write_bool(true);
+        bits.write_unsigned(gap);
+        bits.write(!e->before ? full_entry :
+                   !e->now ? removed_entry : delta_entry, 2);
+        write_payload(bits, e->before, e->now, format);
+        previous_id = id;
+        first = false;
+      }
+    }
+    // Record what the receiver will hold
+    const replicated_body * held = e->send ? e->now : e->before;
+    if(held) next.bodies.push_back(*held);
+  }
+  bits.write_bool(false);
+  return sequence;
+}
+void replication_encoder::acknowledge(std::uint16_t sequence)
+{
+  const frame & f = frames[sequence % history];
+  if(!f.valid || f.sequence != sequence) return;
+  // Only move forward, allowing for wraparound
+  if( acknowledged &&
+      static_cast<std::int16_t>(sequence - baseline) <= 0 )
+    return;
+  acknowledged = true;
+  baseline = sequence;
+}
+
+
+replication_decoder::frame::frame()
+: sequence(0),
+  valid(false)
+{}
+replication_decoder::replication_decoder(const replication_format & format_)
+: format(format_),
+  frames(replication_encoder::history)
+{}
+
+std::uint16_t replication_decoder::decode(const unsigned char * data,
+                                          std::size_t size,
+                                          std::vector<body_state> & states)
+{
+  static const std::size_t history = replication_encoder::history;
+  bit_reader bits(data, size);
+  const std::uint16_t sequence = bits.read(16);
+  static const std::vector<replicated_body> none;
+  const std::vector<replicated_body> * old = &none;
+  if( bits.read_bool() )
+  {
+    std::uint16_t baseline = bits.read(16);
+    const frame & f = frames[baseline % history];
+    if(!f.valid || f.sequence != baseline)
+      throw std::runtime_error("replication baseline is no longer known");
+    old = &f.bodies;
+  }
+
+  scratch.clear();
+  auto i = old->begin();
+  std::uint32_t previous_id = 0;
+  bool first = true;
+  while( bits.read_bool() )
+  {
+    std::uint32_t gap = bits.read_unsigned();
+    std::uint32_t id = first ? gap : previous_id + 1 + gap;
+    previous_id = id;
+    first = false;
+    // Bodies the frame skipped are unchanged
+    while(i != old->end() && i->id < id) scratch.push_back(*i++);
+    bool known = i != old->end() && i->id == id;
+
+    switch( bits.read(2) )
+    {
+    case full_entry:
+      {
+        replicated_body b;
+        b.id = id;
+        b.x = bits.read_signed();
+        b.y = bits.read_signed();
+        b.angle = bits.read(format.angle_bits);
+        b.vx = bits.read_signed();
+        b.vy = bits.read_signed();
+        b.spin = bits.read_signed();
+        scratch.push_back(b);
+      }
+      break;
+    case delta_entry:
+      {
+        if(!known)
+          throw std::runtime_error("replication delta for an unknown body");
+        replicated_body b = *i;
+        bool moved = bits.read_bool();
+        bool turned = bits.read_bool();
+        bool accelerated = bits.read_bool();
+        bool spun = bits.read_bool();
+        if(moved)
+        {
+          b.x += bits.read_signed();
+          b.y += bits.read_signed();
+        }
+        if(turned)
+          b.angle = (b.angle + bits.read_signed()) &
+                    ( (1u << format.angle_bits) - 1 );
+        if(accelerated)
+        {
+          b.vx += bits.read_signed();
+          b.vy += bits.read_signed();
+        }
+        if(spun)
+          b.spin += bits.read_signed();
+        scratch.push_back(b);
+      }
+      break;
+    case removed_entry:
+      break;
+    default:
+      throw std::runtime_error("bad replication entry");
+    }
+    if(known) ++i;
+  }
+  scratch.insert( scratch.end(), i, old->end() );
+
+  frame & f = frames[sequence % history];
+  f.bodies.swap(scratch);
+  f.sequence = sequence;
+  f.valid = true;
+
+  states.clear();
+  for(auto b = f.bodies.begin(); b != f.bodies.end(); ++b)
+    states.push_back( b->state(format) );
+  return sequence;
+}
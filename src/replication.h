@@ -0,0 +1,205 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#ifndef REPLICATION_H_INCLUDED
+#define REPLICATION_H_INCLUDED
+
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// Bits are packed least significant first
+class bit_writer
+{
+public:
+  // Appends to buffer_, which must outlive the writer
+  bit_writer(std::vector<unsigned char> & buffer_);
+
+  // Writes the low bits of value; bits may be 0 to 32
+  void write(std::uint32_t value, int bits);
+  void write_bool(bool value);
+  // Zigzag and a 2 bit width class, so small magnitudes stay small
+  void write_signed(std::int32_t value);
+  void write_unsigned(std::uint32_t value);
+
+  std::size_t bits() const;
+
+private:
+  std::vector<unsigned char> & buffer;
+  std::size_t bits_;
+};
+class bit_reader
+{
+public:
+  bit_reader(const unsigned char * data_, std::size_t size);
+
+  // Each throws std::out_of_range when reading past the end
+  std::uint32_t read(int bits);
+  bool read_bool();
+  std::int32_t read_signed();
+  std::uint32_t read_unsigned();
+
+private:
+  const unsigned char * data;
+  std::size_t size_bits, position;
+};
+
+
+/*
+ * Quantization of replicated bodies. Round trips are exact to within half a
+ * step: position_error() metres per axis, angle_error() radians,
+ * velocity_error() metres per second per axis for speeds up to
+ * velocity_limit, and angular_velocity_error() radians per second for spins
+ * up to angular_velocity_limit (faster bodies are clamped).
+ */
+class replication_format
+{
+public:
+  replication_format();
+
+  // Steps per metre
+  float position_scale;
+  // 12 to 16 bits per revolution
+  int angle_bits;
+  // Steps per metre per second
+  float velocity_scale;
+  float velocity_limit;
+  // Steps per radian per second
+  float angular_velocity_scale;
+  float angular_velocity_limit;
+
+  float position_error() const;
+  float angle_error() const;
+  float velocity_error() const;
+  float angular_velocity_error() const;
+};
+
+#include "protocol.h"
+class replicated_body
+{
+public:
+  replicated_body();
+  replicated_body(const body_state & state, const replication_format & format);
+  body_state state(const replication_format & format) const;
+
+  bool operator == (const replicated_body & other) const;
+  bool operator != (const replicated_body & other) const;
+
+  std::uint32_t id;
+  std::int32_t x, y;
+  std::uint32_t angle;
+  std::int32_t vx, vy;
+  std::int32_t spin;
+};
+
+
+/*
+ * Frames are body states bit-packed as changes against the newest frame the
+ * receiver acknowledged, or in full until one is. Bodies whose quantized
+ * state didn't change are skipped, and removed bodies cost a few bits.
+ * Senders keep one encoder per receiver.
+ */
+class replication_encoder
+{
+public:
+  // Frames older than this many can no longer serve as baselines
+  static constexpr std::size_t history = 32;
+
+  replication_encoder( const replication_format & format_ =
+                         replication_format() );
+
+  // Appends a frame holding states to out, most important first. If the
+  // changes don't fit in max_bytes, the least important wait for later
+  // frames. Returns the frame's sequence number.
+  std::uint16_t encode(const std::vector<body_state> & states,
+                       std::vector<unsigned char> & out,
+                       std::size_t max_bytes);
+  // The receiver decoded this frame. Stale or unknown sequences are ignored.
+  void acknowledge(std::uint16_t sequence);
+
+  const replication_format format;
+
+private:
+  class frame
+  {
+  public:
+    frame();
+
+    std::uint16_t sequence;
+    bool valid;
+    // What the receiver holds after decoding, sorted by id
+    std::vector<replicated_body> bodies;
+  };
+  std::vector<frame> frames;
+  std::uint16_t next_sequence;
+  bool acknowledged;
+  std::uint16_t baseline;
+
+  // One body's fate in a frame
+  class event
+  {
+  public:
+    // Null for new bodies
+    const replicated_body * before;
+    // Null for removed bodies
+    const replicated_body * now;
+    // Index in the states passed to encode
+    std::size_t rank;
+    // Estimated size; zero if unchanged
+    std::size_t bits;
+    bool send;
+  };
+  // Reused every encode
+  std::vector<replicated_body> current;
+  std::vector<std::size_t> by_id, by_rank;
+  std::vector<event> events;
+};
+
+class replication_decoder
+{
+public:
+  replication_decoder( const replication_format & format_ =
+                         replication_format() );
+
+  // Decodes a frame into the complete set of bodies it describes, sorted by
+  // id, and returns its sequence number to acknowledge. Throws
+  // std::out_of_range on truncated frames and std::runtime_error when the
+  // baseline is no longer known.
+  std::uint16_t decode(const unsigned char * data, std::size_t size,
+                       std::vector<body_state> & states);
+
+  const replication_format format;
+
+private:
+  class frame
+  {
+  public:
+    frame();
+
+    std::uint16_t sequence;
+    bool valid;
+    std::vector<replicated_body> bodies;
+  };
+  std::vector<frame> frames;
+  // Reused every decode
+  std::vector<replicated_body> scratch;
+};
+
+
+#endif  // REPLICATION_H_INCLUDED
@@ -0,0 +1,50 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#ifndef ARGUMENTS_H_INCLUDED
+#define ARGUMENTS_H_INCLUDED
+
+
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+
+// Parses the value following option argv[i], advancing i past it
+inline unsigned long numeric_argument(int argc, char * argv[], int & i)
+{
+  if(++i == argc)
+    throw std::invalid_argument( std::string(argv[i - 1]) +
+                                 " needs a value" );
+  char * end;
+  unsigned long value = std::strtoul(argv[i], &end, 10);
+  if(*end != '\0' || end == argv[i])
+    throw std::invalid_argument( std::string("bad value ") + argv[i] );
+  return value;
+}
+
+// The value following option argv[i], advancing i past it
+inline const char * string_argument(int argc, char * argv[], int & i)
+{
+  if(++i == argc)
+    throw std::invalid_argument( std::string(argv[i - 1]) +
+                                 " needs a value" );
+  return argv[i];
+}
+
+
+#endif  // ARGUMENTS_H_INCLUDED
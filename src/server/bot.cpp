@@ -0,0 +1,310 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+// Load generator for tdse_server. Each bot is a separate UDP endpoint that
+// sends wandering input every tick and measures what comes back. Predicting
+// bots also run their own soldier locally and reconcile it with the server.
+
+
+#include "interest.h"
+#include "prediction.h"
+#include "replication.h"
+#include "random.h"
+#include <boost/asio.hpp>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <vector>
+using boost::asio::ip::udp;
+class bot
+{
+public:
+  bot(boost::asio::io_context & io, const udp::endpoint & server_,
+      random_engine & prand, bool predict);
+
+  // Wander a little and send input for this tick
+  void send();
+
+  std::uint64_t packets, bytes;
+  // Bodies in the newest frame, and frames that couldn't be decoded
+  std::size_t bodies;
+  std::uint64_t undecodable;
+  std::uint64_t rtt_samples;
+  std::chrono::steady_clock::duration rtt_total;
+  // States reconciled, and ticks replayed doing so
+  std::uint64_t reconciliations;
+  unsigned long long replayed() const;
+
+private:
+  // A world of one soldier, stepped ahead of the server
+  class local_prediction
+  {
+  public:
+    local_prediction(random_engine & prand);
+
+    bullet_world world;
+    soldier avatar;
+    predictor<soldier> local;
+    bool reconciled;
+    std::uint32_t reconciled_ack;
+  };
+
+  udp::socket socket;
+  const udp::endpoint server;
+  random_engine prand_;
+  input_message message;
+  std::vector<unsigned char> send_buffer;
+  std::array<unsigned char, 1500> receive_buffer;
+  udp::endpoint sender;
+  // Send time of recent sequence numbers, to time acknowledgements
+  std::array<std::chrono::steady_clock::time_point, 256> sent;
+  std::uint32_t last_ack;
+  replication_decoder decoder;
+  std::vector<body_state> states;
+  std::unique_ptr<local_prediction> prediction;
+
+  void receive();
+  void handle(std::size_t size);
+};
+
+bot::local_prediction::local_prediction(random_engine & prand)
+: avatar( glm::vec2(0.0f, 0.0f), projectile::properties(0.008f, 1000.0f),
+          prand ),
+  local(world, avatar),
+  reconciled(false),
+  reconciled_ack(0)
+{
+  world.add_body(avatar);
+  // Only movement is predicted; replaying shots would fire them twice
+  world.add_callback( static_cast<biped &>(avatar) );
+}
+
+bot::bot(boost::asio::io_context & io, const udp::endpoint & server_,
+         random_engine & prand, bool predict)
+: packets(0),
+  bytes(0),
+  bodies(0),
+  undecodable(0),
+  rtt_samples(0),
+  rtt_total(0),
+  reconciliations(0),
+  socket( io, udp::endpoint(udp::v4(), 0) ),
+  server(server_),
+  prand_( prand() ),
+  last_ack(0)
+{
+  // What the demo's camera shows
+  message.view_radius = view_radius(glm::vec2(640.0f, 480.0f), 40.0f);
+  if(predict) prediction.reset( new local_prediction(prand_) );
+  receive();
+}
+
+#include <glm/gtc/constants.hpp>
+void bot::send()
+{
+  std::uniform_int_distribution<int> chance(0, 59);
+  if(chance(prand_) == 0)
+  {
+    std::uniform_real_distribution<float> angle(0.0f, 2*glm::pi<float>());
+    float a = angle(prand_);
+    message.controls.movement = glm::vec2( glm::cos(a), glm::sin(a) );
+    a = angle(prand_);
+    message.controls.aim = glm::vec2( glm::cos(a), glm::sin(a) );
+    message.controls.fire = chance(prand_) < 30;
+  }
+
+  if(prediction)
+    message.sequence = prediction->local.step(message.controls).sequence;
+  else ++message.sequence;
+  send_buffer.clear();
+  packet_writer packet(send_buffer);
+  message.write(packet);
+  sent[message.sequence % sent.size()] = std::chrono::steady_clock::now();
+  boost::system::error_code error;
+  socket.send_to(boost::asio::buffer(send_buffer), server, 0, error);
+}
+
+void bot::receive()
+{
+  socket.async_receive_from( boost::asio::buffer(receive_buffer), sender,
+    [this](const boost::system::error_code & error, std::size_t size)
+    {
+      if(error == boost::asio::error::operation_aborted) return;
+      if(!error) handle(size);
+      receive();
+    }
+  );
+}
+void bot::handle(std::size_t size)
+{
+  ++packets;
+  bytes += size;
+  state_header header;
+  try
+  {
+    packet_reader packet(receive_buffer.data(), size);
+    if( packet.u8() != static_cast<std::uint8_t>(message_type::state) )
+      return;
+    header.read(packet);
+    message.frame = decoder.decode(packet.cursor(), packet.remaining(),
+                                   states);
+    message.has_frame = true;
+    bodies = states.size();
+  }
+  catch(const std::exception &)
+  {
+    // Truncated, or against a baseline this bot missed. Later frames are
+    // against newer acknowledgements, so it recovers on its own.
+    ++undecodable;
+    return;
+  }
+
+  // Time each acknowledgement once, if it's recent enough to remember
+  std::int32_t age =
+    static_cast<std::int32_t>(message.sequence - header.ack);
+  if( header.ack != last_ack && age >= 0 && age < int(sent.size()) )
+  {
+    rtt_total += std::chrono::steady_clock::now() -
+                 sent[header.ack % sent.size()];
+    ++rtt_samples;
+    last_ack = header.ack;
+  }
+
+  // Reconcile with each newer acknowledgement, if the frame has our soldier
+  if( !prediction || (prediction->reconciled &&
+      static_cast<std::int32_t>(header.ack - prediction->reconciled_ack) <= 0) )
+    return;
+  auto own = std::lower_bound( states.begin(), states.end(), header.avatar,
+    [](const body_state & s, std::uint32_t id)
+    {
+      return s.id < id;
+    }
+  );
+  if(own == states.end() || own->id != header.avatar) return;
+  prediction->local.reconcile(*own, header.ack);
+  prediction->reconciled = true;
+  prediction->reconciled_ack = header.ack;
+  ++reconciliations;
+}
+unsigned long long bot::replayed() const
+{
+  return prediction ? prediction->local.replayed : 0;
+}
+
+
+#include "arguments.h"
+#include <cstring>
+#include <iostream>
+#include <list>
+#include <string>
+int main(int argc, char * argv[])
+{
+  const char * usage_message =
+    "Usage: tdse_bot [options]\n"
+    "  --host H      server address (default 127.0.0.1)\n"
+    "  --port N      server port (default 7700)\n"
+    "  --clients N   bots to run (default 16)\n"
+    "  --seconds N   how long to run (default 10)\n"
+    "  --predict     predict and reconcile each bot's soldier";
+
+  try
+  {
+    std::string host("127.0.0.1"), port("7700");
+    unsigned long num_clients = 16, seconds = 10;
+    bool predict = false;
+    for(int i = 1; i < argc; ++i)
+    {
+      if( !std::strcmp(argv[i], "--host") && i + 1 < argc )
+        host = argv[++i];
+      else if( !std::strcmp(argv[i], "--port") && i + 1 < argc )
+        port = argv[++i];
+      else if( !std::strcmp(argv[i], "--clients") )
+        num_clients = numeric_argument(argc, argv, i);
+      else if( !std::strcmp(argv[i], "--seconds") )
+        seconds = numeric_argument(argc, argv, i);
+      else if( !std::strcmp(argv[i], "--predict") )
+        predict = true;
+      else
+      {
+        std::cout << usage_message << std::endl;
+        return 1;
+      }
+    }
+
+    boost::asio::io_context io;
+    udp::resolver resolver(io);
+    udp::endpoint server = *resolver.resolve(udp::v4(), host, port).begin();
+
+    random_engine prand( std::random_device()() );
+    std::list<bot> bots;
+    for(unsigned long i = 0; i < num_clients; ++i)
+      bots.emplace_back(io, server, prand, predict);
+
+    typedef std::chrono::steady_clock clock;
+    const auto period = std::chrono::duration_cast<clock::duration>(
+      bullet_world::fixed_substep
+    );
+    const auto start = clock::now();
+    const auto end = start + std::chrono::seconds(seconds);
+    for(auto next = start; next < end; )
+    {
+      for(auto i = bots.begin(); i != bots.end(); ++i)
+        i->send();
+      next += period;
+      io.run_until(next);
+    }
+
+    typedef std::chrono::duration<double, std::milli> double_milliseconds;
+    std::uint64_t packets = 0, bytes = 0, rtt_samples = 0, undecodable = 0;
+    std::size_t bodies = 0;
+    std::uint64_t reconciliations = 0;
+    unsigned long long replayed = 0;
+    clock::duration rtt_total(0);
+    for(auto i = bots.begin(); i != bots.end(); ++i)
+    {
+      packets += i->packets;
+      bytes += i->bytes;
+      rtt_samples += i->rtt_samples;
+      rtt_total += i->rtt_total;
+      undecodable += i->undecodable;
+      bodies = std::max(bodies, i->bodies);
+      reconciliations += i->reconciliations;
+      replayed += i->replayed();
+    }
+    double per_client_second = double( bots.size() )*seconds;
+    if(per_client_second == 0.0) per_client_second = 1.0;
+    std::cout << "clients:           " << bots.size() << '\n'
+              << "packets/s/client:  " << packets/per_client_second << '\n'
+              << "bytes/s/client:    " << bytes/per_client_second << '\n'
+              << "bodies seen:       " << bodies << '\n'
+              << "undecodable:       " << undecodable << '\n'
+              << "mean rtt ms:       "
+              << ( rtt_samples ?
+                   double_milliseconds(rtt_total).count()/rtt_samples : 0.0 )
+              << '\n'
+              << "replays/state:     "
+              << ( reconciliations ? double(replayed)/reconciliations : 0.0 )
+              << std::endl;
+  }
+  catch(const std::exception & e)
+  {
+    std::cout << e.what() << std::endl;
+    return 1;
+  }
+}
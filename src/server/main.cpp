@@ -0,0 +1,187 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#include "server.h"
+#include "arguments.h"
+#include "report.h"
+#include "trace.h"
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+
+
+static void print_stats(const server & s, double seconds)
+{
+  typedef std::chrono::duration<double, std::micro> double_microseconds;
+  const server::run_stats & stats = s.stats();
+  double ticks = stats.ticks ? stats.ticks : 1;
+  std::cout << "ticks:           " << stats.ticks << '\n'
+            << "ticks/s:         " << stats.ticks/seconds << '\n'
+            << "mean tick us:    "
+            << double_microseconds(stats.busy).count()/ticks << '\n'
+            << "slowest tick us: "
+            << double_microseconds(stats.slowest).count() << '\n'
+            << "overruns:        " << stats.overruns << '\n'
+            << "clients:         " << s.clients() << '\n'
+            << "packets in/out:  " << stats.packets_in << " / "
+            << stats.packets_out << '\n'
+            << "bytes in/out:    " << stats.bytes_in << " / "
+            << stats.bytes_out << '\n'
+            << "rejected:        " << stats.rejected << std::endl;
+}
+
+int main(int argc, char * argv[])
+{
+  const char * usage_message =
+    "Usage: tdse_server [options]\n"
+    "  --port N           UDP port to listen on (default 7700)\n"
+    "  --ticks N          stop after N ticks (default: run until signalled)\n"
+    "  --send-interval N  broadcast state every N ticks (default 1)\n"
+    "  --max-clients N    (default 256)\n"
+    "  --threads N        physics worker threads (default 1)\n"
+    "  --seed N           seed spawn positions and weapon spread (default:\n"
+    "                     random)\n"
+    "  --record FILE      record a replay for tdse_replay\n"
+    "  --unthrottled      tick as fast as possible\n"
+    "  --report N         print substep timings every N seconds\n"
+    "  --trace PREFIX     keep a trace of recent ticks, written to\n"
+    "                     PREFIX-TICK.json on SIGUSR1\n"
+    "  --trace-slow US    also write it after physics steps slower than\n"
+    "                     US microseconds (up to 10 times)";
+
+  try
+  {
+    server_options options;
+    std::uint64_t ticks = 0;
+    bool throttled = true;
+    unsigned long report_interval = 0;
+    std::string trace_prefix;
+    unsigned long trace_slow = 0;
+    for(int i = 1; i < argc; ++i)
+    {
+      if( !std::strcmp(argv[i], "--port") )
+      {
+        unsigned long port = numeric_argument(argc, argv, i);
+        if(port > 65535) throw std::invalid_argument("bad port");
+        options.port = port;
+      }
+      else if( !std::strcmp(argv[i], "--ticks") )
+        ticks = numeric_argument(argc, argv, i);
+      else if( !std::strcmp(argv[i], "--send-interval") )
+        options.send_interval = numeric_argument(argc, argv, i);
+      else if( !std::strcmp(argv[i], "--max-clients") )
+        options.max_clients = numeric_argument(argc, argv, i);
+      else if( !std::strcmp(argv[i], "--threads") )
+        options.world.threads = numeric_argument(argc, argv, i);
+      else if( !std::strcmp(argv[i], "--seed") )
+        options.seed = numeric_argument(argc, argv, i);
+      else if( !std::strcmp(argv[i], "--record") )
+        options.record_path = string_argument(argc, argv, i);
+      else if( !std::strcmp(argv[i], "--unthrottled") )
+        throttled = false;
+      else if( !std::strcmp(argv[i], "--report") )
+        report_interval = numeric_argument(argc, argv, i);
+      else if( !std::strcmp(argv[i], "--trace") )
+        trace_prefix = string_argument(argc, argv, i);
+      else if( !std::strcmp(argv[i], "--trace-slow") )
+        trace_slow = numeric_argument(argc, argv, i);
+      else
+      {
+        std::cout << usage_message << std::endl;
+        return 1;
+      }
+    }
+
+    if( trace_slow && trace_prefix.empty() )
+      throw std::invalid_argument("--trace-slow needs --trace");
+
+    boost::asio::io_context io;
+    server s(io, options);
+    boost::asio::signal_set signals(io, SIGINT, SIGTERM);
+    signals.async_wait(
+      [&s](const boost::system::error_code & error, int)
+      {
+        if(!error) s.stop();
+      }
+    );
+
+    // Handlers run between ticks, when the trace can be read safely
+    trace_recorder & tracer = trace_recorder::instance();
+    boost::asio::signal_set dump_signals(io);
+    std::function<void (const boost::system::error_code &, int)> dump =
+      [&](const boost::system::error_code & error, int)
+      {
+        if(error) return;
+        std::string path = trace_prefix + '-' +
+                           std::to_string( s.world().tick() ) + ".json";
+        try
+        {
+          tracer.dump(path);
+          std::cout << "wrote " << path << std::endl;
+        }
+        catch(const std::runtime_error & e)
+        {
+          std::cout << e.what() << std::endl;
+        }
+        dump_signals.async_wait(dump);
+      };
+    if( !trace_prefix.empty() )
+    {
+      tracer.enabled(true);
+      if(trace_slow)
+        tracer.dump_when_slow(std::chrono::microseconds(trace_slow),
+                              trace_prefix);
+#ifdef SIGUSR1
+      dump_signals.add(SIGUSR1);
+      dump_signals.async_wait(dump);
+#endif
+    }
+
+    // Each report covers the interval since the last
+    boost::asio::steady_timer report_timer(io);
+    std::function<void (const boost::system::error_code &)> report =
+      [&](const boost::system::error_code & error)
+      {
+        if(error) return;
+        print_timings( std::cout, s.world() );
+        std::cout << std::endl;
+        s.world().reset_timings();
+        report_timer.expires_after( std::chrono::seconds(report_interval) );
+        report_timer.async_wait(report);
+      };
+    if(report_interval)
+    {
+      report_timer.expires_after( std::chrono::seconds(report_interval) );
+      report_timer.async_wait(report);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    s.run(ticks, throttled);
+    report_timer.cancel();
+    dump_signals.cancel();
+    std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+    print_stats( s, elapsed.count() );
+    print_timings( std::cout, s.world() );
+  }
+  catch(const std::exception & e)
+  {
+    std::cout << e.what() << std::endl;
+    return 1;
+  }
+}
@@ -0,0 +1,187 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#include "arena.h"
+#include "replay.h"
+#include "arguments.h"
+#include "report.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+
+// What one replayed tick cost, and what was going on
+class tick_timing
+{
+public:
+  std::uint64_t tick;
+  double microseconds;
+  std::size_t fighters, projectiles, contacts;
+};
+
+static double percentile(const std::vector<double> & sorted, double p)
+{
+  if( sorted.empty() ) return 0.0;
+  return sorted[ static_cast<std::size_t>( p*(sorted.size() - 1) ) ];
+}
+
+int main(int argc, char * argv[])
+{
+  const char * usage_message =
+    "Usage: tdse_replay FILE [options]\n"
+    "Replays a tdse_server recording as fast as possible.\n"
+    "  --timings FILE  write each tick's time as CSV\n"
+    "  --slowest N     list the N slowest ticks (default 5)\n"
+    "  --threads N     override the recorded physics thread count";
+
+  try
+  {
+    const char * path = nullptr;
+    const char * timings_path = nullptr;
+    std::size_t slowest = 5;
+    bool override_threads = false;
+    unsigned threads = 1;
+    for(int i = 1; i < argc; ++i)
+    {
+      if( !std::strcmp(argv[i], "--timings") )
+        timings_path = string_argument(argc, argv, i);
+      else if( !std::strcmp(argv[i], "--slowest") )
+        slowest = numeric_argument(argc, argv, i);
+      else if( !std::strcmp(argv[i], "--threads") )
+      {
+        threads = numeric_argument(argc, argv, i);
+        override_threads = true;
+      }
+      else if(argv[i][0] != '-' && !path)
+        path = argv[i];
+      else
+      {
+        std::cout << usage_message << std::endl;
+        return 1;
+      }
+    }
+    if(!path)
+    {
+      std::cout << usage_message << std::endl;
+      return 1;
+    }
+
+    replay_reader replay(path);
+    world_options options = replay.header().options;
+    if(override_threads) options.threads = threads;
+    arena game(replay.header().seed, options);
+
+    typedef std::chrono::steady_clock clock;
+    std::vector<tick_timing> timings;
+    replay_event event;
+    auto start = clock::now();
+    while( replay.next(event) )
+    {
+      switch(event.type)
+      {
+      case replay_event::spawn:
+        // Serials count spawns, so a mismatch means a corrupt replay
+        if(game.spawn().serial != event.serial)
+          throw std::runtime_error("replay spawns out of order");
+        break;
+      case replay_event::despawn:
+        game.despawn( game.find(event.serial) );
+        break;
+      case replay_event::input:
+        game.find(event.serial).controls = event.controls;
+        break;
+      case replay_event::tick:
+        {
+          auto tick_start = clock::now();
+          game.tick();
+          std::chrono::duration<double, std::micro> elapsed =
+            clock::now() - tick_start;
+          tick_timing t;
+          t.tick = game.world().tick();
+          t.microseconds = elapsed.count();
+          t.fighters = game.fighters().size();
+          t.projectiles = game.projectiles();
+          t.contacts = game.world().contacts().size();
+          timings.push_back(t);
+        }
+        break;
+      }
+    }
+    std::chrono::duration<double> wall = clock::now() - start;
+
+    if(timings_path)
+    {
+      std::ofstream csv(timings_path);
+      if(!csv)
+        throw std::runtime_error( std::string("can't create ") +
+                                  timings_path );
+      csv << "tick,microseconds,fighters,projectiles,contacts\n";
+      for(auto i = timings.begin(); i != timings.end(); ++i)
+        csv << i->tick << ',' << i->microseconds << ',' << i->fighters << ','
+            << i->projectiles << ',' << i->contacts << '\n';
+    }
+
+    std::vector<double> sorted;
+    sorted.reserve( timings.size() );
+    double total = 0.0;
+    for(auto i = timings.begin(); i != timings.end(); ++i)
+    {
+      sorted.push_back(i->microseconds);
+      total += i->microseconds;
+    }
+    std::sort( sorted.begin(), sorted.end() );
+    double simulated = timings.size()*options.substep.count();
+    std::cout << "ticks:           " << timings.size() << '\n'
+              << "simulated s:     " << simulated << '\n'
+              << "wall s:          " << wall.count() << '\n'
+              << "x realtime:      "
+              << ( wall.count() > 0.0 ? simulated/wall.count() : 0.0 ) << '\n'
+              << "mean tick us:    "
+              << ( timings.empty() ? 0.0 : total/timings.size() ) << '\n'
+              << "p50 tick us:     " << percentile(sorted, 0.5) << '\n'
+              << "p99 tick us:     " << percentile(sorted, 0.99) << '\n'
+              << "max tick us:     " << percentile(sorted, 1.0) << '\n'
+              << "state hash:      " << std::hex << game.world().state_hash()
+              << std::dec << '\n';
+
+    // The slowest ticks, with enough context to reproduce them
+    slowest = std::min( slowest, timings.size() );
+    std::partial_sort( timings.begin(), timings.begin() + slowest,
+                       timings.end(),
+      [](const tick_timing & a, const tick_timing & b)
+      {
+        return a.microseconds > b.microseconds;
+      }
+    );
+    if(slowest) std::cout << "slowest ticks (tick, us, fighters, "
+                             "projectiles, contacts):\n";
+    for(std::size_t i = 0; i != slowest; ++i)
+      std::cout << "  " << timings[i].tick << ' ' << timings[i].microseconds
+                << ' ' << timings[i].fighters << ' ' << timings[i].projectiles
+                << ' ' << timings[i].contacts << '\n';
+    print_timings( std::cout, game.world() );
+    std::cout << std::flush;
+  }
+  catch(const std::exception & e)
+  {
+    std::cout << e.what() << std::endl;
+    return 1;
+  }
+}
@@ -0,0 +1,67 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#ifndef REPORT_H_INCLUDED
+#define REPORT_H_INCLUDED
+
+
+#include "physics.h"
+#include <iomanip>
+#include <ostream>
+
+
+// Mean microseconds per substep spent in each part of the step
+inline void print_timings(std::ostream & out, const bullet_world & world)
+{
+  typedef std::chrono::duration<double, std::micro> double_microseconds;
+  if(!bullet_world::timings_enabled)
+  {
+    out << "(configure with --enable-stats for substep timings)\n";
+    return;
+  }
+  const bullet_world::substep_timings & t = world.timings();
+  double substeps = t.substeps ? t.substeps : 1;
+  auto mean = [substeps](bullet_world::substep_timings::duration d)
+  {
+    return double_microseconds(d).count()/substeps;
+  };
+
+  out << "substeps timed:  " << t.substeps << '\n'
+      << "mean substep us: " << mean(t.total) << '\n'
+      << "slowest us:      " << double_microseconds(t.slowest).count()
+      << '\n';
+  auto accounted = t.broadphase + t.narrowphase + t.solver + t.integration +
+                   t.contacts;
+  for(bullet_world::phase_id i = 0; i != t.phases.size(); ++i)
+  {
+    out << "  " << std::left << std::setw(15) << world.phase_name(i)
+        << std::right << mean(t.phases[i]) << '\n';
+    accounted += t.phases[i];
+  }
+  out << "  broadphase     " << mean(t.broadphase) << '\n'
+      << "  narrowphase    " << mean(t.narrowphase) << '\n'
+      << "  solver         " << mean(t.solver) << '\n'
+      << "  integration    " << mean(t.integration) << '\n'
+      << "  contacts       " << mean(t.contacts) << '\n'
+      << "  other          " << mean(t.total - accounted) << '\n'
+      << "pairs:           " << t.pairs/substeps << '\n'
+      << "manifolds:       " << t.manifolds/substeps << '\n'
+      << "contact events:  " << t.contact_events/substeps << '\n';
+}
+
+
+#endif  // REPORT_H_INCLUDED
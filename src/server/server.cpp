@@ -0,0 +1,287 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#include "server.h"
+#include "protocol.h"
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <tuple>
+
+
+server_options::server_options()
+: port(7700),
+  send_interval(1),
+  max_clients(256),
+  timeout( std::chrono::seconds(5) ),
+  input_queue(4),
+  interest_cell_size(40.0f),
+  view_radius(40.0f),
+  max_view_radius(100.0f),
+  seed(0)
+{}
+
+
+server::run_stats::run_stats()
+: ticks(0),
+  busy(0),
+  slowest(0),
+  overruns(0),
+  packets_in(0),
+  bytes_in(0),
+  packets_out(0),
+  bytes_out(0),
+  rejected(0)
+{}
+
+
+server::client::client(arena::fighter & fighter_)
+: fighter(fighter_),
+  received(0),
+  ack(0),
+  view_radius(0.0f)
+{}
+
+
+using boost::asio::ip::udp;
+server::server(boost::asio::io_context & io_, const server_options & options_)
+: options(options_),
+  io(io_),
+  game( options.seed != 0 ? options.seed : std::random_device()(),
+        options.world ),
+  socket( io, udp::endpoint(udp::v4(), options.port) ),
+  interest(options.interest_cell_size),
+  running(false)
+{
+  if(options.send_interval == 0)
+    throw std::invalid_argument("send interval must be positive");
+  if( !options.record_path.empty() )
+  {
+    recorder.reset( new replay_writer( options.record_path, game.header() ) );
+    game.record( recorder.get() );
+  }
+  receive();
+}
+server::~server()
+{
+  for(auto i = clients_.begin(); i != clients_.end(); )
+    i = drop(i);
+}
+
+void server::run(std::uint64_t ticks, bool throttled)
+{
+  typedef std::chrono::steady_clock clock;
+  const auto period =
+    std::chrono::duration_cast<clock::duration>( game.world().substep() );
+  running = true;
+  auto next = clock::now();
+  for(std::uint64_t i = 0; running && (ticks == 0 || i != ticks); ++i)
+  {
+    io.poll();
+    if( !running || io.stopped() ) break;
+    tick();
+    if(!throttled) continue;
+
+    next += period;
+    auto now = clock::now();
+    if(now > next + period)
+    {
+      // Too far behind to catch up; start counting from now
+      ++stats_.overruns;
+      next = now;
+    }
+    io.run_until(next);
+  }
+  running = false;
+}
+void server::stop()
+{
+  running = false;
+}
+
+void server::tick()
+{
+  auto start = std::chrono::steady_clock::now();
+
+  for(auto i = clients_.begin(); i != clients_.end(); )
+  {
+    if(start - i->second.last_heard > options.timeout)
+    {
+      i = drop(i);
+      continue;
+    }
+    client & c = i->second;
+    // Take the next command; with none waiting, the last controls carry on
+    if( !c.pending.empty() )
+    {
+      c.fighter.controls = c.pending.front().controls;
+      c.ack = c.pending.front().sequence;
+      c.pending.pop_front();
+    }
+    ++i;
+  }
+  game.tick();
+  for(auto i = clients_.begin(); i != clients_.end(); ++i)
+  {
+    const soldier & avatar = i->second.fighter.avatar;
+    interest.move( avatar.id(), avatar.position() );
+  }
+  if(game.world().tick() % options.send_interval == 0) broadcast();
+
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  ++stats_.ticks;
+  stats_.busy += elapsed;
+  if(elapsed > stats_.slowest) stats_.slowest = elapsed;
+}
+
+const server::run_stats & server::stats() const
+{
+  return stats_;
+}
+std::size_t server::clients() const
+{
+  return clients_.size();
+}
+bullet_world & server::world()
+{
+  return game.world();
+}
+
+void server::receive()
+{
+  socket.async_receive_from( boost::asio::buffer(receive_buffer), sender,
+    [this](const boost::system::error_code & error, std::size_t size)
+    {
+      if(error == boost::asio::error::operation_aborted) return;
+      // Other errors (e.g. ICMP unreachable on some platforms) only concern
+      // one datagram
+      if(!error) handle(size);
+      receive();
+    }
+  );
+}
+void server::handle(std::size_t size)
+{
+  ++stats_.packets_in;
+  stats_.bytes_in += size;
+  input_message message;
+  try
+  {
+    packet_reader packet(receive_buffer.data(), size);
+    if( packet.u8() != static_cast<std::uint8_t>(message_type::input) )
+    {
+      ++stats_.rejected;
+      return;
+    }
+    message.read(packet);
+  }
+  catch(const std::out_of_range &)
+  {
+    ++stats_.rejected;
+    return;
+  }
+
+  auto found = clients_.find(sender);
+  if( found == clients_.end() )
+  {
+    if(clients_.size() >= options.max_clients)
+    {
+      ++stats_.rejected;
+      return;
+    }
+    found = spawn(sender);
+  }
+  else if(static_cast<std::int32_t>(message.sequence -
+                                    found->second.received) <= 0)
+  {
+    // Stale or duplicate; still proof the client is alive
+    if(message.has_frame) found->second.encoder.acknowledge(message.frame);
+    found->second.last_heard = std::chrono::steady_clock::now();
+    return;
+  }
+  client & c = found->second;
+  if(message.has_frame) c.encoder.acknowledge(message.frame);
+  c.view_radius = message.view_radius;
+  c.received = message.sequence;
+  c.last_heard = std::chrono::steady_clock::now();
+  // Applying commands in order, one per tick, keeps acknowledgements in step
+  // with the client's prediction
+  input_command command;
+  command.sequence = message.sequence;
+  command.controls = message.controls;
+  c.pending.push_back(command);
+  if(c.pending.size() > options.input_queue) c.pending.pop_front();
+}
+
+server::client_map::iterator server::spawn(const udp::endpoint & endpoint)
+{
+  arena::fighter & fighter = game.spawn();
+  auto result = clients_.emplace( std::piecewise_construct,
+                                  std::forward_as_tuple(endpoint),
+                                  std::forward_as_tuple(fighter) );
+  const soldier & avatar = fighter.avatar;
+  interest.insert( avatar.id(), avatar.position() );
+  return result.first;
+}
+server::client_map::iterator server::drop(client_map::iterator c)
+{
+  interest.erase( c->second.fighter.avatar.id() );
+  game.despawn(c->second.fighter);
+  return clients_.erase(c);
+}
+
+void server::broadcast()
+{
+  states.clear();
+  state_index.clear();
+  for(auto i = clients_.begin(); i != clients_.end(); ++i)
+  {
+    state_index[ i->second.fighter.avatar.id() ] = states.size();
+    states.emplace_back(i->second.fighter.avatar);
+  }
+
+  for(auto i = clients_.begin(); i != clients_.end(); ++i)
+  {
+    client & c = i->second;
+    float radius = c.view_radius > 0.0f ?
+      std::min(c.view_radius, options.max_view_radius) : options.view_radius;
+    c.interest.update( interest, c.fighter.avatar.position(), radius );
+    relevant_states.clear();
+    const std::vector<relevant_entity> & relevant = c.interest.relevant();
+    for(auto j = relevant.begin(); j != relevant.end(); ++j)
+      relevant_states.push_back( states[ state_index[j->id] ] );
+
+    state_header header;
+    header.tick = static_cast<std::uint32_t>( game.world().tick() );
+    header.ack = c.ack;
+    header.avatar = c.fighter.avatar.id();
+    datagram.clear();
+    packet_writer packet(datagram);
+    header.write(packet);
+    // Nearest bodies go first; whatever doesn't fit waits for later frames
+    c.encoder.encode(relevant_states, datagram,
+                     max_datagram - state_header_size);
+
+    boost::system::error_code error;
+    std::size_t sent =
+      socket.send_to(boost::asio::buffer(datagram), i->first, 0, error);
+    // A full send buffer only costs this client one frame
+    if(error) continue;
+    ++stats_.packets_out;
+    stats_.bytes_out += sent;
+  }
+}
@@ -0,0 +1,151 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#ifndef SERVER_H_INCLUDED
+#define SERVER_H_INCLUDED
+
+
+#include "arena.h"
+#include "interest.h"
+#include "prediction.h"
+#include "replication.h"
+#include <boost/asio.hpp>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+class server_options
+{
+public:
+  server_options();
+
+  unsigned short port;
+  // Ticks between state broadcasts
+  unsigned send_interval;
+  // Datagrams from further endpoints are ignored
+  std::size_t max_clients;
+  // Clients that send nothing for this long lose their soldier
+  std::chrono::steady_clock::duration timeout;
+  // Inputs waiting to be applied, one per tick, beyond which the oldest are
+  // dropped. Longer queues ride out more jitter but add latency.
+  std::size_t input_queue;
+  // Clients see bodies within their requested view radius, capped at
+  // max_view_radius, or view_radius if they don't ask
+  float interest_cell_size;
+  float view_radius;
+  float max_view_radius;
+  world_options world;
+  // Zero picks one at random
+  std::uint32_t seed;
+  // Record a replay here, unless empty
+  std::string record_path;
+};
+
+
+/*
+ * Authoritative simulation. Each endpoint that sends input gets a soldier;
+ * every tick the next input from each client is applied, the world is
+ * stepped once, and each client gets a replication frame of the bodies
+ * near its soldier, nearest first, against the last frame it acknowledged.
+ */
+class server
+{
+public:
+  // Larger datagrams risk fragmentation
+  static constexpr std::size_t max_datagram = 1200;
+
+  server(boost::asio::io_context & io_, const server_options & options_);
+  ~server();
+  server(const server &) = delete;
+  void operator = (const server &) = delete;
+
+  // Tick at the world's substep rate, handling datagrams in between. Zero
+  // ticks runs until stop(). Unthrottled servers tick back to back, which
+  // measures how fast the simulation itself can go.
+  void run(std::uint64_t ticks, bool throttled = true);
+  void stop();
+  // Apply input, step once and broadcast if due
+  void tick();
+
+  class run_stats
+  {
+  public:
+    run_stats();
+
+    std::uint64_t ticks;
+    std::chrono::steady_clock::duration busy, slowest;
+    // Throttled ticks that started more than a tick late
+    std::uint64_t overruns;
+    std::uint64_t packets_in, bytes_in, packets_out, bytes_out;
+    // Malformed datagrams, or new clients beyond max_clients
+    std::uint64_t rejected;
+  };
+  const run_stats & stats() const;
+  std::size_t clients() const;
+  bullet_world & world();
+
+private:
+  class client
+  {
+  public:
+    client(arena::fighter & fighter_);
+
+    arena::fighter & fighter;
+    std::deque<input_command> pending;
+    // Newest input sequence received, and newest applied
+    std::uint32_t received, ack;
+    std::chrono::steady_clock::time_point last_heard;
+    float view_radius;
+    interest_set interest;
+    replication_encoder encoder;
+  };
+  typedef std::map<boost::asio::ip::udp::endpoint, client> client_map;
+
+  const server_options options;
+  boost::asio::io_context & io;
+  // Outlives game, which records its last despawns on the way out
+  std::unique_ptr<replay_writer> recorder;
+  arena game;
+  boost::asio::ip::udp::socket socket;
+  interest_grid interest;
+  client_map clients_;
+  bool running;
+  run_stats stats_;
+
+  std::array<unsigned char, max_datagram> receive_buffer;
+  boost::asio::ip::udp::endpoint sender;
+  // Reused every broadcast
+  std::vector<body_state> states, relevant_states;
+  std::unordered_map<std::uint32_t, std::size_t> state_index;
+  std::vector<unsigned char> datagram;
+
+  void receive();
+  void handle(std::size_t size);
+  client_map::iterator spawn(const boost::asio::ip::udp::endpoint & endpoint);
+  client_map::iterator drop(client_map::iterator c);
+  void broadcast();
+};
+
+
+#endif  // SERVER_H_INCLUDED
@@ -35,7 +35,10 @@ ship::ship(const glm::mat3 & transform)
   force_(0.0f, 0.0f),
   torque_(0.0f)
 {
-  forceActivationState(DISABLE_DEACTIVATION);
+  // Idle ships fall asleep, leaving the solver until a control input, a hit
+  // or a collision wakes them. Thresholds are low so drifting ships don't
+  // stop short.
+  setSleepingThresholds(0.05f, 0.05f);
 }
 
 const glm::vec2 & ship::force() const
@@ -47,6 +50,7 @@ void ship::force(const glm::vec2 & f)
   float mag = glm::length(f);
   if(mag <= max_linear_force) force_ = f;
   else force_ = f*(max_linear_force/mag);
+  if(mag != 0.0f) btRigidBody::activate();
 }
 float ship::torque() const
 {
@@ -57,10 +61,20 @@ void ship::torque(float t)
 {
   if(std::abs(t) <= max_torque) torque_ = t;
   else torque_ = std::copysign(max_torque, t);
+  if(t != 0.0f) btRigidBody::activate();
 }
 
 void ship::presubstep(bullet_world & world, float_seconds substep_time)
 {
+  // Keep ships that push against something awake, since Bullet only looks at
+  // velocity when deciding to deactivate
+  if( force_.x != 0.0f || force_.y != 0.0f ||
+      (!rctrl_active && torque_ != 0.0f) )
+    btRigidBody::activate();
+  // Rotation control produces no torque at rest, so a sleeping ship has
+  // nothing to do
+  else if( !isActive() ) return;
+
   if(force_.x != 0.0f || force_.y != 0.0f)
     actor::force(real_orientation()*force_);
 
@@ -68,6 +82,23 @@ void ship::presubstep(bullet_world & world, float_seconds substep_time)
   else actor::torque(torque_);
 }
 
+void ship::save(world_snapshot & snapshot) const
+{
+  snapshot.write(force_);
+  snapshot.write(torque_);
+  snapshot.write(rctrl.target);
+  snapshot.write(rctrl.stop);
+  snapshot.write(rctrl_active);
+}
+void ship::restore(world_snapshot & snapshot)
+{
+  snapshot.read(force_);
+  snapshot.read(torque_);
+  snapshot.read(rctrl.target);
+  snapshot.read(rctrl.stop);
+  snapshot.read(rctrl_active);
+}
+
 
 #include <chrono>
 warship::weapon::weapon(const glm::vec2 & mount_point_,
@@ -99,10 +130,11 @@ void warship::platform::fire(bool enable)
 }
 
 
-warship::warship(const glm::mat3 & transform, std::default_random_engine & prand)
+warship::warship(const glm::mat3 & transform, random_engine & prand)
 : ship(transform),
   weapon_tree(glm::vec2(0.0f, 0.0f), 0.0f),
-  prand_(prand)
+  prand_( prand() ),
+  spread(0.0f, 0.02f)
 {}
 
 void warship::step(const glm::vec2 & offset,
@@ -129,17 +161,15 @@ void warship::step(const glm::vec2 & offset,
       {
         float_seconds remainder = wpn->trigger();
         glm::mat2 orientation =
-          mat2_from_angle( normal_dist(prand_) ) * tree_orientation;
+          mat2_from_angle( spread(prand_) ) * tree_orientation;
 
-        // Create a new projectile
-        projectiles.emplace_back(
+        // Fire period usually elapses before the end of the step, so the
+        // new projectile is stepped ahead by the remaining time
+        world.projectiles().spawn( *this, projectile(
           wpn->bullet(),
           offset_orientation*wpn->mount_point + tree_position,
           orientation*glm::vec2(400.0f, 0.0f) + velocity
-        );
-        // Fire period usually elapses before the end of the step,
-        // so step the new projectile ahead by the remaining time
-        if( projectiles.back().step(world, remainder) ) projectiles.pop_back();
+        ), remainder );
       }
       else
       {
@@ -151,21 +181,44 @@ void warship::step(const glm::vec2 & offset,
   for(auto i = tree.subplatforms.begin(); i != tree.subplatforms.end(); ++i)
     step(tree_position, tree_orientation, *i, world, time);
 }
-void warship::presubstep(bullet_world & world, float_seconds substep_time)
-{
-  ship::presubstep(world, substep_time);
 
-  // Step all projectiles
-  for(auto i = projectiles.begin(); i != projectiles.end(); )
+void warship::save(world_snapshot & snapshot) const
+{
+  ship::save(snapshot);
+  save_tree(weapon_tree, snapshot);
+  snapshot.write(prand_);
+}
+void warship::restore(world_snapshot & snapshot)
+{
+  ship::restore(snapshot);
+  restore_tree(weapon_tree, snapshot);
+  snapshot.read(prand_);
+}
+void warship::save_tree(const platform & tree, world_snapshot & snapshot)
+{
+  for(auto i = tree.weapons.begin(); i != tree.weapons.end(); ++i)
   {
-    // Erase projectiles that collide or expire
-    if( i->step(world, substep_time) )
-      i = projectiles.erase(i);
-    else ++i;
+    snapshot.write(i->cooldown);
+    snapshot.write(i->enabled);
   }
+  for(auto i = tree.subplatforms.begin(); i != tree.subplatforms.end(); ++i)
+    save_tree(*i, snapshot);
+}
+void warship::restore_tree(platform & tree, world_snapshot & snapshot)
+{
+  for(auto i = tree.weapons.begin(); i != tree.weapons.end(); ++i)
+  {
+    snapshot.read(i->cooldown);
+    snapshot.read(i->enabled);
+  }
+  for(auto i = tree.subplatforms.begin(); i != tree.subplatforms.end(); ++i)
+    restore_tree(*i, snapshot);
+}
+
+void warship::presubstep(bullet_world & world, float_seconds substep_time)
+{
+  ship::presubstep(world, substep_time);
 
   // Fire all weapons and step subplatforms
   step(real_position(), real_orientation(), weapon_tree, world, substep_time);
 }
-
-std::normal_distribution<float> warship::normal_dist(0.0f, 0.02f);
@@ -26,7 +26,7 @@ with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
 #include <array>
 
 
-class ship : public actor, public needs_presubstep
+class ship : public actor, public needs_presubstep, public needs_snapshot
 {
 public:
   static constexpr float max_linear_force = 512.0f;
@@ -46,6 +46,9 @@ public:
   rotation_control rctrl;
   bool rctrl_active;
 
+  void save(world_snapshot & snapshot) const override;
+  void restore(world_snapshot & snapshot) override;
+
 protected:
   void presubstep(bullet_world & world, float_seconds substep_time) override;
 
@@ -55,11 +58,11 @@ private:
 };
 
 
-#include <list>
-#include <random>
+#include <vector>
+#include "random.h"
 #include "turret.h"
 #include "shooter.h"
-class warship : public ship
+class warship : public ship, public projectile_owner
 {
 public:
   class weapon : public periodic
@@ -87,15 +90,17 @@ public:
 
     glm::vec2 offset;
     float offset_angle;
-    std::list<weapon> weapons;
-    std::list<platform> subplatforms;
+    std::vector<weapon> weapons;
+    std::vector<platform> subplatforms;
   };
 
 
   platform weapon_tree;
-  std::list<projectile> projectiles;
 
-  warship(const glm::mat3 & transform, std::default_random_engine & prand);
+  warship(const glm::mat3 & transform, random_engine & prand);
+
+  void save(world_snapshot & snapshot) const override;
+  void restore(world_snapshot & snapshot) override;
 
 protected:
   void step(const glm::vec2 & offset, const glm::mat2 & offset_orientation,
@@ -103,8 +108,13 @@ protected:
   void presubstep(bullet_world & world, float_seconds substep_time) override;
 
 private:
-  std::default_random_engine & prand_;
-  static std::normal_distribution<float> normal_dist;
+  // Only cooldowns and triggers; the tree's layout is assumed unchanged
+  static void save_tree(const platform & tree, world_snapshot & snapshot);
+  static void restore_tree(platform & tree, world_snapshot & snapshot);
+
+  // Seeded from the constructor's engine, as with soldier
+  random_engine prand_;
+  normal_variate spread;
 };
 
 
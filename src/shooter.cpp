@@ -44,17 +44,18 @@ shooter::shooter(float_seconds fire_period)
 : periodic(fire_period),
   enabled(false)
 {}
+void shooter::save(world_snapshot & snapshot) const
+{
+  snapshot.write(cooldown);
+  snapshot.write(enabled);
+}
+void shooter::restore(world_snapshot & snapshot)
+{
+  snapshot.read(cooldown);
+  snapshot.read(enabled);
+}
 void shooter::presubstep(bullet_world & world, float_seconds substep_time)
 {
-  // Step all projectiles
-  for(auto i = projectiles.begin(); i != projectiles.end(); )
-  {
-    // Erase projectiles that collide or expire
-    if( i->step(world, substep_time) )
-      i = projectiles.erase(i);  // Erase returns next projectile.
-    else ++i;
-  }
-
   step(substep_time);
   while( ready() )
   {
@@ -62,11 +63,9 @@ void shooter::presubstep(bullet_world & world, float_seconds substep_time)
     {
       float_seconds remainder = trigger();
 
-      // Create a new projectile
-      projectiles.emplace_back( fire() );
-      // Fire period usually elapses before the end of the substep,
-      // so step the new projectile ahead with the remaining substep time
-      if( projectiles.back().step(world, remainder) ) projectiles.pop_back();
+      // Fire period usually elapses before the end of the substep, so the
+      // new projectile is stepped ahead by the remaining substep time
+      world.projectiles().spawn( *this, fire(), remainder );
     }
     else
     {
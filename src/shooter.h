@@ -27,15 +27,19 @@ private:
 };
 
 
-#include <list>
-class shooter : public periodic, public needs_presubstep
+// Fires into the world's projectile_system, tagging shots with itself
+class shooter : public periodic, public needs_presubstep,
+                public projectile_owner
 {
 public:
   shooter(float_seconds fire_period);
 
-  std::list<projectile> projectiles;
   bool enabled;
 
+  // For use by the owning body's needs_snapshot implementation
+  void save(world_snapshot & snapshot) const;
+  void restore(world_snapshot & snapshot);
+
 protected:
   void presubstep(bullet_world & world, float_seconds substep_time) override;
   virtual projectile fire() = 0;
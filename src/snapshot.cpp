@@ -0,0 +1,56 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#include "snapshot.h"
+#include <cstring>
+#include <stdexcept>
+
+
+world_snapshot::world_snapshot()
+: read_position(0)
+{}
+
+void world_snapshot::reserve(std::size_t bytes)
+{
+  data.reserve(bytes);
+}
+std::size_t world_snapshot::size() const
+{
+  return data.size();
+}
+void world_snapshot::clear()
+{
+  data.clear();
+  read_position = 0;
+}
+void world_snapshot::rewind()
+{
+  read_position = 0;
+}
+
+void world_snapshot::write_bytes(const void * bytes, std::size_t count)
+{
+  const unsigned char * begin = static_cast<const unsigned char *>(bytes);
+  data.insert(data.end(), begin, begin + count);
+}
+void world_snapshot::read_bytes(void * bytes, std::size_t count)
+{
+  if(count > data.size() - read_position)
+    throw std::out_of_range("read past the end of a world_snapshot");
+  std::memcpy(bytes, data.data() + read_position, count);
+  read_position += count;
+}
@@ -0,0 +1,80 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#ifndef SNAPSHOT_H_INCLUDED
+#define SNAPSHOT_H_INCLUDED
+
+
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+
+/*
+ * Flat buffer of simulation state for rollback. Values are copied byte for
+ * byte, so only trivially copyable types may be written, and a snapshot is
+ * only meaningful to the process that made it. The buffer keeps its capacity
+ * when cleared, so once it has grown to fit a world, saving doesn't allocate.
+ */
+class world_snapshot
+{
+public:
+  world_snapshot();
+
+  void reserve(std::size_t bytes);
+  std::size_t size() const;
+  // Start writing from the beginning
+  void clear();
+  // Start reading from the beginning
+  void rewind();
+
+  template<class T> void write(const T & value);
+  // Throws std::out_of_range when reading past the end
+  template<class T> void read(T & value);
+
+private:
+  std::vector<unsigned char> data;
+  std::size_t read_position;
+
+  void write_bytes(const void * bytes, std::size_t count);
+  void read_bytes(void * bytes, std::size_t count);
+};
+
+template<class T> void world_snapshot::write(const T & value)
+{
+  static_assert(std::is_trivially_copyable<T>::value,
+                "snapshots hold raw bytes");
+  write_bytes( &value, sizeof(T) );
+}
+template<class T> void world_snapshot::read(T & value)
+{
+  static_assert(std::is_trivially_copyable<T>::value,
+                "snapshots hold raw bytes");
+  read_bytes( &value, sizeof(T) );
+}
+
+
+// Bodies implementing this are saved and restored along with the world
+class needs_snapshot
+{
+public:
+  virtual void save(world_snapshot & snapshot) const = 0;
+  virtual void restore(world_snapshot & snapshot) = 0;
+};
+
+
+#endif  // SNAPSHOT_H_INCLUDED
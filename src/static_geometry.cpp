@@ -0,0 +1,41 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#include "static_geometry.h"
+
+
+compound_holder::compound_holder()
+// Enable the compound's internal dynamic AABB tree
+: compound(true)
+{}
+
+
+static_geometry::static_geometry()
+: body( 0.0f, compound, glm::mat3(1.0f) )
+{}
+
+void static_geometry::add(const btCollisionShape & shape,
+                          const glm::mat3 & transform)
+{
+  // Compounds never modify their children either
+  compound.addChildShape( glm2d_to_bt(transform),
+                          const_cast<btCollisionShape *>(&shape) );
+}
+int static_geometry::size() const
+{
+  return compound.getNumChildShapes();
+}
@@ -0,0 +1,54 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#ifndef STATIC_GEOMETRY_H_INCLUDED
+#define STATIC_GEOMETRY_H_INCLUDED
+
+
+#include "physics.h"
+
+
+// Owns the compound shape, so it's constructed before the body that uses it
+class compound_holder
+{
+protected:
+  compound_holder();
+
+  btCompoundShape compound;
+};
+
+
+/*
+ * Many static shapes baked into one immovable body. The compound keeps its
+ * own AABB tree, so the world sees a single broadphase proxy and a single
+ * collision object however many pieces a level has. Add every piece before
+ * adding the body to a world.
+ */
+class static_geometry : private compound_holder, public body
+{
+public:
+  static_geometry();
+  static_geometry(const static_geometry &) = delete;
+  void operator = (const static_geometry &) = delete;
+
+  // Shapes are not copied and must outlive this object
+  void add(const btCollisionShape & shape, const glm::mat3 & transform);
+  int size() const;
+};
+
+
+#endif  // STATIC_GEOMETRY_H_INCLUDED
@@ -0,0 +1,203 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#include "trace.h"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+
+trace_recorder & trace_recorder::instance()
+{
+  static trace_recorder recorder;
+  return recorder;
+}
+trace_recorder::trace_recorder()
+: epoch( clock::now() ),
+  enabled_(false),
+  slow_threshold(0),
+  slow_dumps_left(0)
+{}
+
+bool trace_recorder::enabled() const
+{
+  return enabled_.load(std::memory_order_relaxed);
+}
+void trace_recorder::enabled(bool e)
+{
+  enabled_.store(e, std::memory_order_relaxed);
+}
+
+trace_recorder::ring::ring(unsigned thread_)
+: thread(thread_),
+  head(0),
+  events(new trace_event[ring_size])
+{}
+trace_recorder::ring & trace_recorder::local_ring()
+{
+  // Rings belong to the recorder, so spans survive their thread
+  thread_local ring * local = nullptr;
+  if(!local)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    rings.emplace_back( new ring( rings.size() ) );
+    local = rings.back().get();
+  }
+  return *local;
+}
+void trace_recorder::record(const trace_event & event)
+{
+  ring & r = local_ring();
+  std::uint64_t head = r.head.load(std::memory_order_relaxed);
+  r.events[head % ring_size] = event;
+  r.head.store(head + 1, std::memory_order_release);
+}
+const char * trace_recorder::intern(const std::string & name)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return names.insert(name).first->c_str();
+}
+
+
+#ifdef __GNUG__
+#include <cstdlib>
+#include <cxxabi.h>
+static std::string type_name(const std::type_info & type)
+{
+  int status;
+  char * demangled = abi::__cxa_demangle(type.name(), nullptr, nullptr,
+                                         &status);
+  if(!demangled) return type.name();
+  std::string name(demangled);
+  std::free(demangled);
+  return name;
+}
+#else
+static std::string type_name(const std::type_info & type)
+{
+  return type.name();
+}
+#endif
+
+static void write_string(std::ostream & out, const std::string & s)
+{
+  out << '"';
+  for(auto i = s.begin(); i != s.end(); ++i)
+  {
+    if(*i == '"' || *i == '\\') out << '\\' << *i;
+    else if( static_cast<unsigned char>(*i) < 0x20 ) out << ' ';
+    else out << *i;
+  }
+  out << '"';
+}
+
+void trace_recorder::write_json(std::ostream & out) const
+{
+  typedef std::chrono::duration<double, std::micro> double_microseconds;
+  std::lock_guard<std::mutex> lock(mutex);
+  out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  bool first = true;
+  std::vector<trace_event> copy;
+  for(auto r = rings.begin(); r != rings.end(); ++r)
+  {
+    out << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\","
+        << "\"pid\":1,\"tid\":" << (*r)->thread
+        << ",\"args\":{\"name\":\"thread " << (*r)->thread << "\"}}";
+    first = false;
+
+    // Copy what's there, then drop whatever was overwritten meanwhile
+    std::uint64_t head = (*r)->head.load(std::memory_order_acquire);
+    std::uint64_t begin = head > ring_size ? head - ring_size : 0;
+    copy.clear();
+    for(std::uint64_t i = begin; i != head; ++i)
+      copy.push_back( (*r)->events[i % ring_size] );
+    std::uint64_t after = (*r)->head.load(std::memory_order_acquire);
+    std::uint64_t overwritten = after > ring_size ? after - ring_size : 0;
+    std::size_t skip = overwritten > begin ?
+      std::min<std::uint64_t>(overwritten - begin, copy.size()) : 0;
+
+    out << std::fixed << std::setprecision(3);
+    for(auto e = copy.begin() + skip; e != copy.end(); ++e)
+    {
+      out << ",\n{\"name\":";
+      write_string( out, e->type ? type_name(*e->type) : e->name );
+      out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << (*r)->thread
+          << ",\"ts\":" << double_microseconds(e->begin - epoch).count()
+          << ",\"dur\":" << double_microseconds(e->end - e->begin).count();
+      if(e->count) out << ",\"args\":{\"count\":" << e->count << '}';
+      out << '}';
+    }
+    out << std::defaultfloat;
+  }
+  out << "\n]}" << std::endl;
+}
+void trace_recorder::dump(const std::string & path) const
+{
+  std::ofstream file(path);
+  if(!file) throw std::runtime_error("can't create trace file " + path);
+  write_json(file);
+  if(!file) throw std::runtime_error("can't write trace file " + path);
+}
+void trace_recorder::clear()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  for(auto r = rings.begin(); r != rings.end(); ++r)
+    (*r)->head.store(0, std::memory_order_release);
+}
+
+void trace_recorder::dump_when_slow(clock::duration threshold,
+                                    const std::string & path_prefix,
+                                    unsigned max_dumps)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  slow_prefix = path_prefix;
+  slow_dumps_left = max_dumps;
+  slow_threshold.store(threshold.count(), std::memory_order_relaxed);
+}
+void trace_recorder::step_finished(const char * name, clock::time_point begin,
+                                   std::uint64_t tick)
+{
+  trace_event event;
+  event.name = name;
+  event.type = nullptr;
+  event.count = 0;
+  event.begin = begin;
+  event.end = clock::now();
+  record(event);
+
+  clock::duration::rep threshold =
+    slow_threshold.load(std::memory_order_relaxed);
+  if( threshold == 0 || (event.end - begin).count() < threshold ) return;
+  std::string path;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if(slow_dumps_left == 0) return;
+    --slow_dumps_left;
+    path = slow_prefix + '-' + std::to_string(tick) + ".json";
+  }
+  try
+  {
+    dump(path);
+  }
+  catch(const std::runtime_error &)
+  {
+    // Don't let a full disk stop the simulation; just stop trying
+    std::lock_guard<std::mutex> lock(mutex);
+    slow_dumps_left = 0;
+  }
+}
@@ -0,0 +1,149 @@
+/*
+Copyright (C) 2016 Jeremy Starnes
+
+This file is part of TDSE.
+
+TDSE is free software: you can redistribute it and/or modify it under the terms
+of the GNU Affero General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+TDSE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public License along
+with TDSE; see the file COPYING. If not, see <http://www.gnu.org/licenses/agpl>
+*/
+#ifndef TRACE_H_INCLUDED
+#define TRACE_H_INCLUDED
+
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+
+// One timed span. Named by a string that outlives the recorder (a literal
+// or trace_recorder::intern), or by the dynamic type of what ran.
+class trace_event
+{
+public:
+  const char * name;
+  const std::type_info * type;
+  // How many callbacks a span covers, or zero
+  std::uint32_t count;
+  std::chrono::steady_clock::time_point begin, end;
+};
+
+/*
+ * Flight recorder for the simulation. Each thread writes spans to its own
+ * fixed-size ring, overwriting the oldest, with no locks or allocation, so
+ * it can stay on in production. The rings can be written out as Chrome
+ * Trace Event JSON (chrome://tracing, ui.perfetto.dev) on demand, or
+ * automatically after a slow step.
+ *
+ * Rings are read without stopping their writers, so dump or clear from the
+ * thread that steps the world, between steps, when Bullet's workers are
+ * idle.
+ */
+class trace_recorder
+{
+public:
+  typedef std::chrono::steady_clock clock;
+  // Spans kept per thread
+  static constexpr std::size_t ring_size = 1 << 14;
+
+  static trace_recorder & instance();
+  trace_recorder(const trace_recorder &) = delete;
+  void operator = (const trace_recorder &) = delete;
+
+  // Off by default; disabled recorders don't read the clock
+  bool enabled() const;
+  void enabled(bool e);
+
+  void record(const trace_event & event);
+  // A copy of name that lives as long as the process
+  const char * intern(const std::string & name);
+
+  // Every buffered span, oldest first. Throws std::runtime_error if the
+  // file can't be written.
+  void write_json(std::ostream & out) const;
+  void dump(const std::string & path) const;
+  void clear();
+
+  // After a bullet_world step slower than threshold, dump to
+  // path_prefix-TICK.json, up to max_dumps times or until a dump fails. A
+  // zero threshold stops.
+  void dump_when_slow(clock::duration threshold,
+                      const std::string & path_prefix,
+                      unsigned max_dumps = 10);
+  // Called by bullet_world at the end of each step
+  void step_finished(const char * name, clock::time_point begin,
+                     std::uint64_t tick);
+
+private:
+  class ring
+  {
+  public:
+    ring(unsigned thread_);
+
+    const unsigned thread;
+    std::atomic<std::uint64_t> head;
+    std::unique_ptr<trace_event[]> events;
+  };
+
+  trace_recorder();
+  ring & local_ring();
+
+  const clock::time_point epoch;
+  std::atomic<bool> enabled_;
+  // Guards registering rings, interning and dump settings, none of which
+  // happen per span
+  mutable std::mutex mutex;
+  std::vector< std::unique_ptr<ring> > rings;
+  std::set<std::string> names;
+  std::atomic<clock::duration::rep> slow_threshold;
+  std::string slow_prefix;
+  unsigned slow_dumps_left;
+};
+
+// Records the span from construction to destruction, if tracing is on
+class trace_scope
+{
+public:
+  explicit trace_scope(const char * name, std::uint32_t count = 0);
+  ~trace_scope();
+  trace_scope(const trace_scope &) = delete;
+  void operator = (const trace_scope &) = delete;
+
+private:
+  trace_event event;
+  bool active;
+};
+
+inline trace_scope::trace_scope(const char * name, std::uint32_t count)
+: active( trace_recorder::instance().enabled() )
+{
+  if(!active) return;
+  event.name = name;
+  event.type = nullptr;
+  event.count = count;
+  event.begin = trace_recorder::clock::now();
+}
+inline trace_scope::~trace_scope()
+{
+  if(!active) return;
+  event.end = trace_recorder::clock::now();
+  trace_recorder::instance().record(event);
+}
+
+
+#endif  // TRACE_H_INCLUDED